@@ -0,0 +1,369 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "AsyncLog.h"
+
+#define ASYNC_LOG_LINE 64
+/** The items of a string argument, its length and its bytes. */
+#define LOG_STRING_ITEMS (1 + (LOG_STRING_MAX + sizeof(void *)) / sizeof(void *))
+/** The items of the biggest record. */
+#define LOG_RECORD_MAX (2 + LOG_ARGS_MAX * LOG_STRING_ITEMS)
+/** The room kept in the output buffer for one conversion. */
+#define LOG_PIECE_MAX 512
+/** The idle rounds of the background thread before it starts to sleep. */
+#define LOG_IDLE_SPINS 64
+/** The first and the longest sleep of the idle background thread, in nanoseconds. */
+#define LOG_IDLE_SLEEP_MIN 1000
+#define LOG_IDLE_SLEEP_MAX 1000000
+
+struct LogThread {
+    Queue queue;
+    AsyncLogger * logger;
+    /** The part of the last record not yet written, handled by the thread. */
+    void * tail[LOG_RECORD_MAX];
+    int tailCount;
+    unsigned long volatile dropped;
+    /** The record being read, handled by the background thread. */
+    void * record[LOG_RECORD_MAX] __attribute__((aligned(ASYNC_LOG_LINE)));
+    int recordCount;
+};
+
+struct AsyncLogger {
+    int fd;
+    int maxThreads;
+    LogPolicy policy;
+    int volatile threadCount;
+    int volatile stopping;
+    LogThread * threads;
+    void * sectors;
+    char * buffer;
+    size_t bufferSize;
+    size_t used;
+    pthread_t background;
+};
+
+/** Writes the output buffer, all of it. */
+static void flushOutput(AsyncLogger * const logger) {
+    for (size_t done = 0; done < logger->used;) {
+        register ssize_t const written = write(logger->fd, logger->buffer + done,
+                logger->used - done);
+        if (written < 0 && errno == EINTR) continue;
+        /* Nowhere to report it, the output is lost. */
+        if (written <= 0) break;
+        done += written;
+    }
+    logger->used = 0;
+}
+
+static void append(AsyncLogger * const logger, char const * const text, size_t const length) {
+    if (logger->bufferSize - logger->used < length) flushOutput(logger);
+    register size_t const fit = length < logger->bufferSize ? length : logger->bufferSize;
+    memcpy(logger->buffer + logger->used, text, fit);
+    logger->used += fit;
+}
+
+/** Formats one conversion with the argument of the record at "item". */
+static void convert(AsyncLogger * const logger, char * const spec, size_t length,
+        LogType const type, void * const * const item) {
+    register char const conversion = spec[length - 1];
+    register uint64_t const bits = (uintptr_t)item[0];
+    union {
+        uint64_t bits;
+        double value;
+    } number;
+    number.bits = bits;
+    register long long const integer = type == logDouble ? (long long)number.value : (long long)bits;
+    register double const real = type == logDouble ? number.value
+        : type == logInt ? (double)(long long)bits : (double)bits;
+    if (logger->bufferSize - logger->used < LOG_PIECE_MAX) flushOutput(logger);
+    register char * const out = logger->buffer + logger->used;
+    register size_t const room = logger->bufferSize - logger->used < LOG_PIECE_MAX
+        ? logger->bufferSize - logger->used : LOG_PIECE_MAX;
+    register int printed = 0;
+    if (strchr("diouxXc", conversion)) {
+        /* The integers are long long, whatever the format says. */
+        spec[length - 1] = 'l';
+        spec[length] = 'l';
+        spec[length + 1] = conversion;
+        spec[length + 2] = 0;
+        printed = conversion == 'c' ? snprintf(out, room, "%c", (int)integer)
+            : snprintf(out, room, spec, integer);
+    } else if (strchr("feEgGaAF", conversion)) {
+        printed = snprintf(out, room, spec, real);
+    } else if (conversion == 's') {
+        if (type == logString) {
+            char text[LOG_STRING_MAX + 1];
+            register size_t const size = (uintptr_t)item[0];
+            memcpy(text, item + 1, size);
+            text[size] = 0;
+            printed = snprintf(out, room, spec, text);
+        } else {
+            printed = snprintf(out, room, spec, "(?)");
+        }
+    } else if (conversion == 'p') {
+        printed = snprintf(out, room, spec, (void *)(uintptr_t)bits);
+    }
+    if (printed > 0) logger->used += (size_t)printed < room ? (size_t)printed : room - 1;
+}
+
+/** Formats a whole record into the output buffer. */
+static void formatRecord(AsyncLogger * const logger, void * const * const record) {
+    register char const * format = record[0];
+    register uint64_t const meta = (uintptr_t)record[1];
+    register int const count = (meta >> 16) & 0xff;
+    register void * const * item = record + 2;
+    register int arg = 0;
+    char spec[64];
+    while (*format) {
+        register char const * const percent = strchr(format, '%');
+        if (!percent) {
+            append(logger, format, strlen(format));
+            break;
+        }
+        append(logger, format, percent - format);
+        if (percent[1] == '%') {
+            append(logger, "%", 1);
+            format = percent + 2;
+            continue;
+        }
+        /* The flags, the width and the precision are kept, the length modifiers not. */
+        register char const * end = percent + 1;
+        register size_t length = 1;
+        spec[0] = '%';
+        while (*end && strchr("-+ #0123456789.", *end) && length < sizeof(spec) - 4)
+            spec[length++] = *end++;
+        while (*end && strchr("hlLqjzt", *end)) ++end;
+        if (!*end || arg >= count || !strchr("diouxXcfeEgGaAFsp", *end)) {
+            /* No argument for it, or a conversion we do not know, as it is. */
+            append(logger, percent, (*end ? end + 1 : end) - percent);
+            format = *end ? end + 1 : end;
+            continue;
+        }
+        spec[length++] = *end;
+        spec[length] = 0;
+        register LogType const type = (meta >> (24 + 4 * arg)) & 0xf;
+        convert(logger, spec, length, type, item);
+        item += type == logString
+            ? 1 + ((uintptr_t)item[0] + sizeof(void *) - 1) / sizeof(void *) : 1;
+        ++arg;
+        format = end + 1;
+    }
+}
+
+/**
+ * Reads from the queue of a thread the rest of the record being read.
+ * @return 1 if the record is whole.
+ */
+static int readRecord(LogThread * const thread) {
+    register int got;
+    if (thread->recordCount < 2) {
+        got = readItems(&thread->queue, thread->record + thread->recordCount,
+                2 - thread->recordCount);
+        if (got > 0) thread->recordCount += got;
+    }
+    if (thread->recordCount < 2) return 0;
+    register int const total = (uintptr_t)thread->record[1] & 0xffff;
+    if (thread->recordCount < total) {
+        got = readItems(&thread->queue, thread->record + thread->recordCount,
+                total - thread->recordCount);
+        if (got > 0) thread->recordCount += got;
+    }
+    return thread->recordCount == total;
+}
+
+static void * background(void * arg) {
+    AsyncLogger * const logger = arg;
+    register int idleRounds = 0;
+    register long int sleep = 0;
+    for (;;) {
+        register int const stopping = logger->stopping;
+        register int idle = 1;
+        for (int t = 0; t < logger->threadCount; ++t) {
+            register LogThread * const thread = &logger->threads[t];
+            /* Stopped, nobody else touches the rest of the last record. */
+            if (stopping && thread->tailCount) {
+                register int const written = writeItems(&thread->queue, thread->tail,
+                        thread->tailCount);
+                memmove(thread->tail, thread->tail + written,
+                        sizeof(void *) * (thread->tailCount - written));
+                thread->tailCount -= written;
+                idle = 0;
+            }
+            while (readRecord(thread)) {
+                formatRecord(logger, thread->record);
+                thread->recordCount = 0;
+                idle = 0;
+            }
+        }
+        if (!idle) {
+            idleRounds = 0;
+            sleep = 0;
+            continue;
+        }
+        flushOutput(logger);
+        if (stopping) return NULL;
+        if (++idleRounds < LOG_IDLE_SPINS) {
+            sched_yield();
+            continue;
+        }
+        /* Nothing for a while: sleep, twice as long every round up to the cap. */
+        sleep = !sleep ? LOG_IDLE_SLEEP_MIN
+            : sleep < LOG_IDLE_SLEEP_MAX / 2 ? sleep * 2 : LOG_IDLE_SLEEP_MAX;
+        struct timespec const pause = {0, sleep};
+        nanosleep(&pause, NULL);
+    }
+}
+
+AsyncLogger * createAsyncLogger(int const fd, int const threads, int const sectors,
+        int const itemsPerSector, LogPolicy const policy, size_t const bufferSize) {
+    if (fd < 0 || threads <= 0 || sectors < 2 || itemsPerSector <= 0
+            || (long int)(sectors - 1) * itemsPerSector < 2 * (long int)LOG_RECORD_MAX
+            || (policy != logDrop && policy != logBlock) || bufferSize < LOG_PIECE_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector)
+            + ASYNC_LOG_LINE - 1) / ASYNC_LOG_LINE * ASYNC_LOG_LINE;
+    AsyncLogger * const logger = calloc(1, sizeof(AsyncLogger));
+    if (!logger) return NULL;
+    logger->fd = fd;
+    logger->maxThreads = threads;
+    logger->policy = policy;
+    logger->bufferSize = bufferSize;
+    logger->buffer = malloc(bufferSize);
+    if (!logger->buffer
+            || posix_memalign((void **)&logger->threads, ASYNC_LOG_LINE, sizeof(LogThread) * threads)
+            || posix_memalign(&logger->sectors, ASYNC_LOG_LINE, sectorSize * sectors * threads)) {
+        free(logger->buffer);
+        free(logger->threads);
+        free(logger);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (int t = 0; t < threads; ++t) {
+        register LogThread * const thread = &logger->threads[t];
+        thread->queue = mkQueue();
+        thread->logger = logger;
+        thread->tailCount = 0;
+        thread->dropped = 0;
+        thread->recordCount = 0;
+        for (int s = 0; s < sectors; ++s)
+            submitSector(&thread->queue,
+                    (char *)logger->sectors + sectorSize * (t * sectors + s), sectorSize);
+    }
+    register int const error = pthread_create(&logger->background, NULL, background, logger);
+    if (error) {
+        free(logger->sectors);
+        free(logger->threads);
+        free(logger->buffer);
+        free(logger);
+        errno = error;
+        return NULL;
+    }
+    return logger;
+}
+
+LogThread * asyncLogThread(AsyncLogger * const logger) {
+    /* The background thread looks only at the queues below the count. */
+    register int index;
+    do {
+        index = logger->threadCount;
+        if (index == logger->maxThreads) {
+            errno = ENOSPC;
+            return NULL;
+        }
+    } while (!__sync_bool_compare_and_swap(&logger->threadCount, index, index + 1));
+    return &logger->threads[index];
+}
+
+/** Writes the rest of the last record, as the policy says. */
+static int writeTail(LogThread * const thread) {
+    for (;;) {
+        register int const written = writeItems(&thread->queue, thread->tail, thread->tailCount);
+        memmove(thread->tail, thread->tail + written,
+                sizeof(void *) * (thread->tailCount - written));
+        thread->tailCount -= written;
+        if (!thread->tailCount) return 0;
+        if (thread->logger->policy == logDrop) return -1;
+        sched_yield();
+    }
+}
+
+int asyncLogRecord(LogThread * const thread, int const count, LogArg const * const args) {
+    if (thread->tailCount && writeTail(thread)) {
+        ++thread->dropped;
+        errno = ENOMEM;
+        return -1;
+    }
+    void * record[LOG_RECORD_MAX];
+    register int const arguments = count - 1 < LOG_ARGS_MAX ? count - 1 : LOG_ARGS_MAX;
+    register int total = 2;
+    register uint64_t types = 0;
+    record[0] = (void *)(uintptr_t)args[0].bits;
+    for (int a = 0; a < arguments; ++a) {
+        register LogArg const * const arg = &args[a + 1];
+        types |= (uint64_t)arg->type << (4 * a);
+        if (arg->type != logString) {
+            record[total++] = (void *)(uintptr_t)arg->bits;
+            continue;
+        }
+        register char const * const text = (char const *)(uintptr_t)arg->bits;
+        register size_t const length = text ? strnlen(text, LOG_STRING_MAX) : 0;
+        record[total++] = (void *)length;
+        memcpy(record + total, text, length);
+        total += (length + sizeof(void *) - 1) / sizeof(void *);
+    }
+    record[1] = (void *)(uintptr_t)(total | arguments << 16 | types << 24);
+    register int const written = writeItems(&thread->queue, record, total);
+    if (written == total) return 0;
+    if (!written && thread->logger->policy == logDrop) {
+        ++thread->dropped;
+        errno = ENOMEM;
+        return -1;
+    }
+    /* The read side has the start of it, the rest has to follow. */
+    memcpy(thread->tail, record + written, sizeof(void *) * (total - written));
+    thread->tailCount = total - written;
+    if (thread->logger->policy == logBlock) writeTail(thread);
+    return 0;
+}
+
+unsigned long asyncLogDropped(AsyncLogger const * const logger) {
+    register unsigned long dropped = 0;
+    for (int t = 0; t < logger->threadCount; ++t) dropped += logger->threads[t].dropped;
+    return dropped;
+}
+
+void destroyAsyncLogger(AsyncLogger * const logger) {
+    if (!logger) return;
+    logger->stopping = 1;
+    pthread_join(logger->background, NULL);
+    free(logger->sectors);
+    free(logger->threads);
+    free(logger->buffer);
+    free(logger);
+}
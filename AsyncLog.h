@@ -0,0 +1,179 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdint.h>
+
+#include "TransThread.h"
+
+/** The most arguments of a record, after the format. */
+#define LOG_ARGS_MAX 8
+
+/** The most bytes of a string argument copied into a record. */
+#define LOG_STRING_MAX 255
+
+/** The types of the arguments, as they are kept in a record. */
+typedef enum LogType {
+    logInt,
+    logUnsigned,
+    logDouble,
+    logPointer,
+    logString
+} LogType;
+
+/** An argument of 'asyncLog', before it is put into the queue. */
+typedef struct LogArg {
+    LogType type;
+    uint64_t bits;
+} LogArg;
+
+/** What a thread does when its queue is full. */
+typedef enum LogPolicy {
+    /** Drops the record and counts it. */
+    logDrop,
+    /** Waits for room. */
+    logBlock
+} LogPolicy;
+
+/**
+ * A logger that formats in the background.
+ *
+ * Every thread that logs has its own queue to the background thread. A record
+ * goes into the queue as a few items: the pointer to the format, a word with
+ * the number of items and the types of the arguments, then the arguments as
+ * they are, 8 bytes each; a string argument is copied into the items, the
+ * format is not, it has to live as long as the logger, a string literal.
+ * The background thread formats the records into a big buffer and writes it
+ * with one write when it is full or when the queues are empty. When the
+ * queues stay empty it sleeps, longer and longer up to a millisecond, so an
+ * idle logger does not hold a CPU; a record can wait that long to be written.
+ *
+ * A record is written with one 'writeItems'. If the queue takes only a part of
+ * it the thread keeps the rest and writes it first the next time, so the read
+ * side never sees records mixed up; with logDrop a record that finds the rest
+ * of the previous one still waiting is dropped.
+ */
+typedef struct AsyncLogger AsyncLogger;
+
+/** The queue of one thread to the logger. */
+typedef struct LogThread LogThread;
+
+/**
+ * Creates a logger and starts its background thread.
+ * @param fd where the records are written.
+ * @param threads the most threads that can log.
+ * @param sectors the number of sectors of every queue, at least 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @param policy what a thread does when its queue is full.
+ * @param bufferSize the size of the output buffer.
+ * @return the logger, NULL on failure (EINVAL if a queue could not hold two of
+ * the biggest records).
+ */
+AsyncLogger * createAsyncLogger(int const fd, int const threads, int const sectors,
+        int const itemsPerSector, LogPolicy const policy, size_t const bufferSize);
+
+/**
+ * Gives a queue to the calling thread, the thread passes it to 'asyncLog'.
+ * @return the queue, NULL if all of them were given (ENOSPC).
+ */
+LogThread * asyncLogThread(AsyncLogger * const logger);
+
+/**
+ * Puts a record into the queue of a thread, called through 'asyncLog'.
+ * @return On success 0, -1 if it was dropped (ENOMEM).
+ */
+int asyncLogRecord(LogThread * const thread, int const count, LogArg const * const args);
+
+/** @return the records dropped by all the threads. */
+unsigned long asyncLogDropped(AsyncLogger const * const logger);
+
+/**
+ * Stops the background thread after it wrote all the records and releases
+ * the logger. Must be called when no thread logs any more.
+ */
+void destroyAsyncLogger(AsyncLogger * const logger);
+
+static inline uint64_t logBitsInt(long long const value) {
+    return value;
+}
+
+static inline uint64_t logBitsUnsigned(unsigned long long const value) {
+    return value;
+}
+
+static inline uint64_t logBitsDouble(double const value) {
+    union {
+        double value;
+        uint64_t bits;
+    } tmp;
+    tmp.value = value;
+    return tmp.bits;
+}
+
+static inline uint64_t logBitsPointer(void const * const value) {
+    return (uintptr_t)value;
+}
+
+#define LOG_TYPE(x) _Generic((x), \
+    char: logInt, signed char: logInt, short: logInt, int: logInt, long: logInt, \
+    long long: logInt, _Bool: logUnsigned, unsigned char: logUnsigned, \
+    unsigned short: logUnsigned, unsigned int: logUnsigned, unsigned long: logUnsigned, \
+    unsigned long long: logUnsigned, float: logDouble, double: logDouble, \
+    char *: logString, char const *: logString, default: logPointer)
+
+#define LOG_BITS(x) _Generic((x), \
+    char: logBitsInt, signed char: logBitsInt, short: logBitsInt, int: logBitsInt, \
+    long: logBitsInt, long long: logBitsInt, _Bool: logBitsUnsigned, \
+    unsigned char: logBitsUnsigned, unsigned short: logBitsUnsigned, \
+    unsigned int: logBitsUnsigned, unsigned long: logBitsUnsigned, \
+    unsigned long long: logBitsUnsigned, float: logBitsDouble, double: logBitsDouble, \
+    default: logBitsPointer)(x)
+
+#define LOG_ARG(x) {LOG_TYPE(x), LOG_BITS(x)}
+
+#define LOG_COUNT(...) LOG_COUNT_(__VA_ARGS__, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, n, ...) n
+
+#define LOG_MAP(...) LOG_MAP_(LOG_COUNT(__VA_ARGS__), __VA_ARGS__)
+#define LOG_MAP_(n, ...) LOG_MAP__(n, __VA_ARGS__)
+#define LOG_MAP__(n, ...) LOG_MAP_##n(__VA_ARGS__)
+#define LOG_MAP_1(a) LOG_ARG(a)
+#define LOG_MAP_2(a, ...) LOG_ARG(a), LOG_MAP_1(__VA_ARGS__)
+#define LOG_MAP_3(a, ...) LOG_ARG(a), LOG_MAP_2(__VA_ARGS__)
+#define LOG_MAP_4(a, ...) LOG_ARG(a), LOG_MAP_3(__VA_ARGS__)
+#define LOG_MAP_5(a, ...) LOG_ARG(a), LOG_MAP_4(__VA_ARGS__)
+#define LOG_MAP_6(a, ...) LOG_ARG(a), LOG_MAP_5(__VA_ARGS__)
+#define LOG_MAP_7(a, ...) LOG_ARG(a), LOG_MAP_6(__VA_ARGS__)
+#define LOG_MAP_8(a, ...) LOG_ARG(a), LOG_MAP_7(__VA_ARGS__)
+#define LOG_MAP_9(a, ...) LOG_ARG(a), LOG_MAP_8(__VA_ARGS__)
+
+/**
+ * Logs a record, like printf: asyncLog(thread, "took %d ms\n", ms).
+ * The format must be a string literal, up to LOG_ARGS_MAX arguments follow.
+ * The integers are kept as long long, so the length modifiers of the format
+ * do not matter; the '*' width and precision are not supported.
+ * @return On success 0, -1 if it was dropped.
+ */
+#define asyncLog(thread, ...) asyncLogRecord((thread), LOG_COUNT(__VA_ARGS__), \
+    (LogArg const []){LOG_MAP(__VA_ARGS__)})
+
+#endif
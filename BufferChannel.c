@@ -0,0 +1,208 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+
+#include "BufferChannel.h"
+
+#define BUFFER_CHANNEL_LINE 64
+
+struct BufferChannel {
+    Queue forward;
+    Queue backward;
+    size_t bufferSize;
+    int buffers;
+    int returnBatch;
+    char * memory;
+    void * sectors;
+    /** The pool, handled only by the write thread. */
+    void ** pool __attribute__((aligned(BUFFER_CHANNEL_LINE)));
+    int pooled;
+    /** The released buffers, handled only by the read thread. */
+    void ** released __attribute__((aligned(BUFFER_CHANNEL_LINE)));
+    int releasedCount;
+};
+
+BufferChannel * createBufferChannel(int const buffers, size_t const bufferSize,
+        int const itemsPerSector, int const returnBatch) {
+    if (buffers <= 0 || !bufferSize || itemsPerSector <= 0 || returnBatch <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector)
+            + BUFFER_CHANNEL_LINE - 1) / BUFFER_CHANNEL_LINE * BUFFER_CHANNEL_LINE;
+    /* Enough for all the buffers plus a sector half read and one half written. */
+    register int const sectors = (buffers + itemsPerSector - 1) / itemsPerSector + 2;
+    BufferChannel * channel;
+    if (posix_memalign((void **)&channel, BUFFER_CHANNEL_LINE, sizeof(BufferChannel))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    channel->bufferSize = (bufferSize + BUFFER_CHANNEL_LINE - 1)
+        / BUFFER_CHANNEL_LINE * BUFFER_CHANNEL_LINE;
+    channel->buffers = buffers;
+    channel->returnBatch = returnBatch < buffers ? returnBatch : buffers;
+    channel->pool = malloc(sizeof(void *) * buffers);
+    channel->released = malloc(sizeof(void *) * buffers);
+    channel->memory = NULL;
+    channel->sectors = NULL;
+    if (!channel->pool || !channel->released
+            || posix_memalign((void **)&channel->memory, BUFFER_CHANNEL_LINE,
+                channel->bufferSize * buffers)
+            || posix_memalign(&channel->sectors, BUFFER_CHANNEL_LINE,
+                sectorSize * sectors * 2)) {
+        destroyBufferChannel(channel);
+        errno = ENOMEM;
+        return NULL;
+    }
+    channel->forward = mkQueue();
+    channel->backward = mkQueue();
+    for (int s = 0; s < sectors; ++s) {
+        submitSector(&channel->forward, (char *)channel->sectors + sectorSize * s, sectorSize);
+        submitSector(&channel->backward,
+                (char *)channel->sectors + sectorSize * (sectors + s), sectorSize);
+    }
+    /* The first buffers on the top of the pool. */
+    for (int b = 0; b < buffers; ++b)
+        channel->pool[b] = channel->memory + channel->bufferSize * (buffers - 1 - b);
+    channel->pooled = buffers;
+    channel->releasedCount = 0;
+    return channel;
+}
+
+size_t channelBufferSize(BufferChannel const * const channel) {
+    return channel ? channel->bufferSize : 0;
+}
+
+/** @return true if the buffer is one of the channel. */
+static int ownBuffer(BufferChannel const * const channel, void const * const buffer) {
+    register char const * const memory = channel->memory;
+    return (char const *)buffer >= memory
+        && (char const *)buffer < memory + channel->bufferSize * channel->buffers
+        && !(((char const *)buffer - memory) % channel->bufferSize);
+}
+
+void * channelAlloc(BufferChannel * const channel) {
+    if (!channel) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!channel->pooled) {
+        /* The return lane is never closed, but a -1 must not get into the count. */
+        register int const returned = readItems(&channel->backward, channel->pool,
+                channel->buffers);
+        channel->pooled = returned > 0 ? returned : 0;
+    }
+    if (!channel->pooled) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return channel->pool[--channel->pooled];
+}
+
+int channelFree(BufferChannel * const channel, void * const buffer) {
+    if (!channel || !ownBuffer(channel, buffer) || channel->pooled == channel->buffers) {
+        errno = EINVAL;
+        return -1;
+    }
+    channel->pool[channel->pooled++] = buffer;
+    return 0;
+}
+
+int channelSend(BufferChannel * const channel, void * const buffer) {
+    if (!channel || !ownBuffer(channel, buffer)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return writeItem(&channel->forward, buffer);
+}
+
+int channelSendItems(BufferChannel * const channel, void * const * const buffers,
+        int const count) {
+    if (!channel || (!buffers && count) || count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < count; ++i)
+        if (!ownBuffer(channel, buffers[i])) {
+            errno = EINVAL;
+            return -1;
+        }
+    return writeItems(&channel->forward, buffers, count);
+}
+
+int channelClose(BufferChannel * const channel) {
+    if (!channel) {
+        errno = EINVAL;
+        return -1;
+    }
+    return closeQueue(&channel->forward);
+}
+
+void * channelReceive(BufferChannel * const channel) {
+    if (!channel) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return readItem(&channel->forward);
+}
+
+int channelReceiveItems(BufferChannel * const channel, void ** const buffers,
+        int const count) {
+    if (!channel) {
+        errno = EINVAL;
+        return -1;
+    }
+    return readItems(&channel->forward, buffers, count);
+}
+
+int channelRelease(BufferChannel * const channel, void * const buffer) {
+    if (!channel || !ownBuffer(channel, buffer)
+            || channel->releasedCount == channel->buffers) {
+        errno = EINVAL;
+        return -1;
+    }
+    channel->released[channel->releasedCount++] = buffer;
+    if (channel->releasedCount == channel->returnBatch) channelFlushReturns(channel);
+    return 0;
+}
+
+int channelFlushReturns(BufferChannel * const channel) {
+    if (!channel) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int const returned =
+        writeItems(&channel->backward, channel->released, channel->releasedCount);
+    if (returned <= 0) return 0;
+    /* The return lane holds all the buffers, but keep the rest anyway. */
+    for (int i = returned; i < channel->releasedCount; ++i)
+        channel->released[i - returned] = channel->released[i];
+    channel->releasedCount -= returned;
+    return returned;
+}
+
+void destroyBufferChannel(BufferChannel * const channel) {
+    if (!channel) return;
+    free(channel->sectors);
+    free(channel->memory);
+    free(channel->released);
+    free(channel->pool);
+    free(channel);
+}
@@ -0,0 +1,130 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUFFER_CHANNEL_H
+#define BUFFER_CHANNEL_H
+
+#include "TransThread.h"
+
+/**
+ * A queue of buffers from a write thread to a read thread with a second queue,
+ * the return lane, that brings the used buffers back.
+ *
+ * The buffers are allocated once, at creation, and belong to the write
+ * thread's pool. 'channelAlloc' takes one from the pool, 'channelSend' passes
+ * it to the read thread, 'channelRelease' gives it back. The read thread
+ * gathers the released buffers and returns them in batches with 'writeItems'
+ * on the return lane; the write thread refills its pool from the return lane
+ * with 'readItems' when the pool is empty.
+ *
+ * So once running no thread calls malloc or free, a buffer is freed by the
+ * thread that allocated it and the pool is reused last in first out, while
+ * it is still in the cache of the write thread.
+ *
+ * Both queues hold all the buffers, they never get full.
+ */
+typedef struct BufferChannel BufferChannel;
+
+/**
+ * Creates a channel and its buffers.
+ * @param buffers the number of buffers.
+ * @param bufferSize the size of every buffer, rounded up to a cache line.
+ * @param itemsPerSector the number of items in every sector of the two queues.
+ * @param returnBatch the number of released buffers returned at once.
+ * @return the channel, NULL on failure.
+ */
+BufferChannel * createBufferChannel(int const buffers, size_t const bufferSize,
+        int const itemsPerSector, int const returnBatch);
+
+/** @return the size of the buffers of the channel. */
+size_t channelBufferSize(BufferChannel const * const channel);
+
+/**
+ * Takes a buffer from the pool, from the write thread.
+ * @return the buffer, NULL if all the buffers are out (ENOMEM).
+ */
+void * channelAlloc(BufferChannel * const channel);
+
+/**
+ * Puts back into the pool a buffer taken but not sent, from the write thread.
+ * @return On success 0, -1 otherwise (EINVAL if it is not a buffer of the
+ * channel or the pool is already full).
+ */
+int channelFree(BufferChannel * const channel, void * const buffer);
+
+/**
+ * Sends a buffer to the read thread.
+ * @return On success 0, -1 otherwise (EINVAL if it is not a buffer of the
+ * channel).
+ */
+int channelSend(BufferChannel * const channel, void * const buffer);
+
+/**
+ * Sends a batch of buffers to the read thread.
+ * @return the number of buffers sent, -1 on invalid arguments (EINVAL, also
+ * if one is not a buffer of the channel, then none is sent).
+ */
+int channelSendItems(BufferChannel * const channel, void * const * const buffers,
+        int const count);
+
+/**
+ * Closes the channel, from the write thread, nothing is sent after it.
+ * The buffers already sent are still received and the return lane stays open.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int channelClose(BufferChannel * const channel);
+
+/**
+ * Receives a buffer, from the read thread.
+ * @return the buffer, NULL if there is none, QUEUE_END if the channel was
+ * closed and all the buffers sent were received.
+ */
+void * channelReceive(BufferChannel * const channel);
+
+/**
+ * Receives up to count buffers, from the read thread.
+ * @return the number of buffers received, -1 on invalid arguments (EINVAL) or
+ * once the channel was closed and all the buffers sent were received (EPIPE).
+ */
+int channelReceiveItems(BufferChannel * const channel, void ** const buffers,
+        int const count);
+
+/**
+ * Gives a received buffer back, from the read thread.
+ * It is returned to the write thread with the next batch.
+ * @return On success 0, -1 otherwise (EINVAL if it is not a buffer of the
+ * channel or more buffers were released then there are).
+ */
+int channelRelease(BufferChannel * const channel, void * const buffer);
+
+/**
+ * Returns now the released buffers not yet returned, from the read thread,
+ * for example before it waits for more work.
+ * @return the number of buffers returned, -1 on invalid arguments.
+ */
+int channelFlushReturns(BufferChannel * const channel);
+
+/**
+ * Releases the channel and all the buffers.
+ * Must be called when no thread uses the channel.
+ */
+void destroyBufferChannel(BufferChannel * const channel);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+
+#include "ConflatingQueue.h"
+
+#define CONFLATING_QUEUE_LINE 64
+
+typedef struct Cell {
+    uint64_t key;
+    /** Set once, by the write thread, when the key gets the cell. */
+    int used;
+    /** The pending value, NULL if the read thread took it. */
+    void * volatile value;
+} Cell;
+
+struct ConflatingQueue {
+    Queue queue;
+    /** The index, open addressing over a power of 2 of cells. */
+    Cell * cells;
+    unsigned long mask;
+    int keys;
+    int maxKeys;
+    unsigned long conflated;
+    void * sectors;
+};
+
+static inline unsigned long hashOf(uint64_t const key) {
+    return (key * 0x9e3779b97f4a7c15ull) >> 17;
+}
+
+ConflatingQueue * createConflatingQueue(int const keys, int const sectors,
+        int const itemsPerSector) {
+    if (keys <= 0 || sectors < 2 || itemsPerSector <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector)
+            + CONFLATING_QUEUE_LINE - 1) / CONFLATING_QUEUE_LINE * CONFLATING_QUEUE_LINE;
+    register unsigned long size = 2;
+    while (size < 2ul * keys) size <<= 1;
+    ConflatingQueue * const queue = calloc(1, sizeof(ConflatingQueue));
+    if (!queue) return NULL;
+    queue->cells = calloc(size, sizeof(Cell));
+    if (!queue->cells || posix_memalign(&queue->sectors, CONFLATING_QUEUE_LINE,
+                sectorSize * sectors)) {
+        destroyConflatingQueue(queue);
+        errno = ENOMEM;
+        return NULL;
+    }
+    queue->mask = size - 1;
+    queue->maxKeys = keys;
+    queue->queue = mkQueue();
+    for (int s = 0; s < sectors; ++s)
+        submitSector(&queue->queue, (char *)queue->sectors + sectorSize * s, sectorSize);
+    return queue;
+}
+
+/** @return the cell of a key, a new one if it had none, NULL if full. */
+static Cell * cellOf(ConflatingQueue * const queue, uint64_t const key) {
+    for (register unsigned long slot = hashOf(key);; ++slot) {
+        register Cell * const cell = &queue->cells[slot & queue->mask];
+        if (cell->used && cell->key == key) return cell;
+        if (cell->used) continue;
+        if (queue->keys == queue->maxKeys) return NULL;
+        ++queue->keys;
+        cell->key = key;
+        cell->used = 1;
+        return cell;
+    }
+}
+
+int conflateWrite(ConflatingQueue * const queue, uint64_t const key, void * const value) {
+    if (!queue || !value) {
+        errno = EINVAL;
+        return -1;
+    }
+    register Cell * const cell = cellOf(queue, key);
+    if (!cell) {
+        errno = ENOSPC;
+        return -1;
+    }
+    /* The read thread may be taking the old value just now. */
+    if (__sync_lock_test_and_set(&cell->value, value)) {
+        ++queue->conflated;
+        return 1;
+    }
+    /* The cell is out of the queue, nobody else sees the value. */
+    if (writeItem(&queue->queue, cell)) {
+        cell->value = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void * conflateRead(ConflatingQueue * const queue, uint64_t * const key) {
+    if (!queue) return NULL;
+    register Cell * const cell = readItem(&queue->queue);
+    if (!cell || cell == QUEUE_END) return NULL;
+    if (key) *key = cell->key;
+    return __sync_lock_test_and_set(&cell->value, NULL);
+}
+
+unsigned long conflatedCount(ConflatingQueue const * const queue) {
+    return queue->conflated;
+}
+
+void destroyConflatingQueue(ConflatingQueue * const queue) {
+    if (!queue) return;
+    free(queue->sectors);
+    free(queue->cells);
+    free(queue);
+}
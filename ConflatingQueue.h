@@ -0,0 +1,79 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CONFLATING_QUEUE_H
+#define CONFLATING_QUEUE_H
+
+#include <stdint.h>
+
+#include "TransThread.h"
+
+/**
+ * A queue of updates where only the newest value of a key matters.
+ *
+ * Every key has a cell holding its pending value. The queue carries cells,
+ * not values: when the write thread writes a value it swaps it into the cell
+ * of the key and, only if the cell had no pending value, writes the cell into
+ * the queue. When the read thread gets a cell it swaps its value out with
+ * NULL. So a key is at most once in the queue and the read thread gets the
+ * newest value, however many were written meanwhile, and the queue never holds
+ * more items then keys.
+ *
+ * The key to cell index is kept by the write thread, the read thread only
+ * follows the cells it gets from the queue. The values must not be NULL.
+ */
+typedef struct ConflatingQueue ConflatingQueue;
+
+/**
+ * Creates a conflating queue.
+ * @param keys the most keys that will be written.
+ * @param sectors the number of sectors of the queue, at least 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @return the queue, NULL on failure.
+ */
+ConflatingQueue * createConflatingQueue(int const keys, int const sectors,
+        int const itemsPerSector);
+
+/**
+ * Writes the newest value of a key, from the write thread.
+ * @return 0 if the key had no pending value, 1 if its pending value was
+ * replaced, -1 on failure (EINVAL for a NULL value, ENOSPC if there are
+ * too many keys, ENOMEM if the queue is full).
+ */
+int conflateWrite(ConflatingQueue * const queue, uint64_t const key, void * const value);
+
+/**
+ * Reads the next key with a pending value, from the read thread.
+ * @param queue the queue.
+ * @param key receives the key, it can be NULL.
+ * @return the newest value of the key, NULL if there is nothing pending.
+ */
+void * conflateRead(ConflatingQueue * const queue, uint64_t * const key);
+
+/** @return the values replaced before being read, counted by the write thread. */
+unsigned long conflatedCount(ConflatingQueue const * const queue);
+
+/**
+ * Releases the queue, the cells and the sectors.
+ * Must be called when no thread uses the queue.
+ */
+void destroyConflatingQueue(ConflatingQueue * const queue);
+
+#endif
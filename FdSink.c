@@ -0,0 +1,139 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "FdSink.h"
+
+struct FdSink {
+    Queue * queue;
+    int fd;
+    FdSinkMode mode;
+    IoRelease release;
+    void * context;
+    /**
+     * The buffers taken from the queue, not yet written, in queue order.
+     * One system call takes at most IOV_MAX vectors, so no more are taken.
+     */
+    IoBuffer * pending[IOV_MAX];
+    int count;
+    /**
+     * The bytes of pending[0] already written: a short writev or sendmsg
+     * stops inside a buffer, the next call starts from there.
+     */
+    size_t offset;
+    /** 1 once the queue was found closed and drained, it is not read again. */
+    int ended;
+    /** Rebuilt from pending on every drain. */
+    struct iovec vectors[IOV_MAX];
+};
+
+FdSink * createFdSink(Queue * const queue, int const fd, FdSinkMode const mode,
+        IoRelease const release, void * const context) {
+    if (!queue || fd < 0 || (mode != sinkWritev && mode != sinkSendmsg) || !release) {
+        errno = EINVAL;
+        return NULL;
+    }
+    FdSink * const sink = malloc(sizeof(FdSink));
+    if (!sink) return NULL;
+    sink->queue = queue;
+    sink->fd = fd;
+    sink->mode = mode;
+    sink->release = release;
+    sink->context = context;
+    sink->count = 0;
+    sink->offset = 0;
+    sink->ended = 0;
+    return sink;
+}
+
+/**
+ * Releases the buffers fully written by "written" bytes and keeps the rest,
+ * moved to the front, with the offset into the first of them.
+ */
+static void consume(FdSink * const sink, size_t written) {
+    register int done = 0;
+    while (done < sink->count
+            && written >= sink->pending[done]->length - sink->offset) {
+        written -= sink->pending[done]->length - sink->offset;
+        sink->offset = 0;
+        sink->release(sink->pending[done++], sink->context);
+    }
+    sink->offset += written;
+    sink->count -= done;
+    memmove(sink->pending, sink->pending + done, sizeof(IoBuffer *) * sink->count);
+}
+
+ssize_t fdSinkDrain(FdSink * const sink) {
+    if (!sink) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* After the end the writer may already reuse the queue, it is not read. */
+    if (!sink->ended && sink->count < IOV_MAX) {
+        register int const got = readItems(sink->queue, (void **)sink->pending + sink->count,
+                IOV_MAX - sink->count);
+        if (got < 0 && errno == EPIPE) sink->ended = 1;
+        if (got > 0) sink->count += got;
+    }
+    if (!sink->count) {
+        if (!sink->ended) return 0;
+        /* Closed and drained, and the pending buffers are written too. */
+        errno = EPIPE;
+        return -1;
+    }
+    for (int i = 0; i < sink->count; ++i) {
+        sink->vectors[i].iov_base = sink->pending[i]->data;
+        sink->vectors[i].iov_len = sink->pending[i]->length;
+    }
+    sink->vectors[0].iov_base = sink->pending[0]->data + sink->offset;
+    sink->vectors[0].iov_len -= sink->offset;
+    register ssize_t written;
+    if (sink->mode == sinkWritev) {
+        written = writev(sink->fd, sink->vectors, sink->count);
+    } else {
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = sink->vectors;
+        message.msg_iovlen = sink->count;
+        written = sendmsg(sink->fd, &message, MSG_NOSIGNAL);
+    }
+    if (written < 0) return -1;
+    consume(sink, written);
+    return written;
+}
+
+int fdSinkPending(FdSink const * const sink) {
+    if (!sink) {
+        errno = EINVAL;
+        return -1;
+    }
+    return sink->count;
+}
+
+void destroyFdSink(FdSink * const sink) {
+    if (!sink) return;
+    for (int i = 0; i < sink->count; ++i) sink->release(sink->pending[i], sink->context);
+    free(sink);
+}
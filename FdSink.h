@@ -0,0 +1,90 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FD_SINK_H
+#define FD_SINK_H
+
+#include <sys/types.h>
+
+#include "TransThread.h"
+
+/** The item of the queues of FdSink and FdSource: a buffer and its length. */
+typedef struct IoBuffer {
+    char * data;
+    size_t length;
+} IoBuffer;
+
+/** Gives a buffer that was written, or dropped, back to its owner. */
+typedef void (*IoRelease)(IoBuffer * const buffer, void * const context);
+
+/** How the sink writes into the file descriptor. */
+typedef enum FdSinkMode {
+    /** writev, for files and pipes. */
+    sinkWritev,
+    /** sendmsg with MSG_NOSIGNAL, for sockets. */
+    sinkSendmsg
+} FdSinkMode;
+
+/**
+ * The read side of a queue of IoBuffer items that writes them into a file
+ * descriptor.
+ *
+ * Each drain takes up to IOV_MAX items from the queue with 'readItems' and
+ * writes them all with one writev or sendmsg. The buffers written to the end
+ * are released through the callback; a buffer written in part is kept,
+ * together with the ones after it, and the next drain goes on from where the
+ * file descriptor stopped. So a non blocking descriptor works too.
+ */
+typedef struct FdSink FdSink;
+
+/**
+ * Creates a sink.
+ * @param queue the queue it reads, the sink is its read thread.
+ * @param fd the file descriptor.
+ * @param mode sinkWritev or sinkSendmsg.
+ * @param release called for every buffer written.
+ * @param context passed to release.
+ * @return the sink, NULL on failure.
+ */
+FdSink * createFdSink(Queue * const queue, int const fd, FdSinkMode const mode,
+        IoRelease const release, void * const context);
+
+/**
+ * Writes what the queue has, with one system call.
+ * @return the number of bytes written, 0 if there was nothing to write, -1 on
+ * failure with errno from the system call (EAGAIN for a full non blocking
+ * descriptor), the buffers are kept in that case; -1 with EPIPE once the queue
+ * was closed and everything in it was written.
+ */
+ssize_t fdSinkDrain(FdSink * const sink);
+
+/**
+ * @return the number of buffers taken from the queue and not yet written, the
+ * first of them may be written in part; -1 for a NULL sink (EINVAL).
+ */
+int fdSinkPending(FdSink const * const sink);
+
+/**
+ * Releases the sink, the buffers not yet written are released through the
+ * callback.
+ */
+void destroyFdSink(FdSink * const sink);
+
+#endif
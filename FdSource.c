@@ -0,0 +1,148 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "FdSource.h"
+
+struct FdSource {
+    BufferChannel * channel;
+    int fd;
+    FdSourceMode mode;
+    int batch;
+    int ended;
+    /** The filled buffers the channel did not take. */
+    unsigned long dropped;
+    size_t capacity;
+    IoBuffer ** buffers;
+    struct iovec * vectors;
+    struct mmsghdr * messages;
+};
+
+FdSource * createFdSource(BufferChannel * const channel, int const fd,
+        FdSourceMode const mode, int const batch) {
+    if (!channel || fd < 0 || (mode != sourceReadv && mode != sourceRecvmmsg)
+            || batch <= 0 || channelBufferSize(channel) <= sizeof(IoBuffer)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    FdSource * const source = calloc(1, sizeof(FdSource));
+    if (!source) return NULL;
+    source->channel = channel;
+    source->fd = fd;
+    source->mode = mode;
+    source->batch = batch < IOV_MAX ? batch : IOV_MAX;
+    source->capacity = channelBufferSize(channel) - sizeof(IoBuffer);
+    source->buffers = malloc(sizeof(IoBuffer *) * source->batch);
+    source->vectors = malloc(sizeof(struct iovec) * source->batch);
+    source->messages = calloc(source->batch, sizeof(struct mmsghdr));
+    if (!source->buffers || !source->vectors || !source->messages) {
+        destroyFdSource(source);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return source;
+}
+
+size_t fdSourceCapacity(FdSource const * const source) {
+    return source->capacity;
+}
+
+/**
+ * Sends the first "filled" buffers and puts the others back into the pool,
+ * with the filled ones the channel did not take, which are counted as dropped.
+ */
+static int publish(FdSource * const source, int const taken, int const filled) {
+    register int const sent = filled
+        ? channelSendItems(source->channel, (void * const *)source->buffers, filled) : 0;
+    register int const error = errno;
+    register int const kept = sent < 0 ? 0 : sent;
+    source->dropped += filled - kept;
+    for (int i = taken - 1; i >= kept; --i) channelFree(source->channel, source->buffers[i]);
+    errno = error;
+    return filled && !kept ? -1 : kept;
+}
+
+int fdSourcePoll(FdSource * const source) {
+    if (!source) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int taken = 0;
+    while (taken < source->batch) {
+        register IoBuffer * const buffer = channelAlloc(source->channel);
+        if (!buffer) break;
+        buffer->data = (char *)(buffer + 1);
+        buffer->length = source->capacity;
+        source->vectors[taken].iov_base = buffer->data;
+        source->vectors[taken].iov_len = source->capacity;
+        source->buffers[taken++] = buffer;
+    }
+    if (!taken) return 0;
+    if (source->mode == sourceReadv) {
+        register ssize_t got = readv(source->fd, source->vectors, taken);
+        if (got < 0) {
+            register int const error = errno;
+            publish(source, taken, 0);
+            errno = error;
+            return -1;
+        }
+        if (!got) source->ended = 1;
+        register int filled = 0;
+        for (; got > 0; got -= source->capacity)
+            source->buffers[filled++]->length =
+                (size_t)got < source->capacity ? (size_t)got : source->capacity;
+        return publish(source, taken, filled);
+    }
+    for (int i = 0; i < taken; ++i) {
+        source->messages[i].msg_hdr.msg_iov = &source->vectors[i];
+        source->messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    register int const got = recvmmsg(source->fd, source->messages, taken,
+            MSG_WAITFORONE, NULL);
+    if (got < 0) {
+        register int const error = errno;
+        publish(source, taken, 0);
+        errno = error;
+        return -1;
+    }
+    for (int i = 0; i < got; ++i) source->buffers[i]->length = source->messages[i].msg_len;
+    return publish(source, taken, got);
+}
+
+int fdSourceEnded(FdSource const * const source) {
+    return source->ended;
+}
+
+unsigned long fdSourceDropped(FdSource const * const source) {
+    return source->dropped;
+}
+
+void destroyFdSource(FdSource * const source) {
+    if (!source) return;
+    free(source->messages);
+    free(source->vectors);
+    free(source->buffers);
+    free(source);
+}
@@ -0,0 +1,85 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FD_SOURCE_H
+#define FD_SOURCE_H
+
+#include <sys/types.h>
+
+#include "BufferChannel.h"
+#include "FdSink.h"
+
+/** How the source reads from the file descriptor. */
+typedef enum FdSourceMode {
+    /** readv over a few buffers, for pipes, files and stream sockets. */
+    sourceReadv,
+    /** recvmmsg, one message per buffer, for datagram sockets. */
+    sourceRecvmmsg
+} FdSourceMode;
+
+/**
+ * The write side of a buffer channel that fills it from a file descriptor.
+ *
+ * Every buffer of the channel starts with an IoBuffer that describes the data
+ * after it, the item the read thread gets is that IoBuffer and it gives it
+ * back with 'channelRelease'. A poll takes up to "batch" buffers from the pool,
+ * fills them with one readv or recvmmsg and sends the filled ones with one
+ * 'channelSendItems', the others go back into the pool.
+ */
+typedef struct FdSource FdSource;
+
+/**
+ * Creates a source.
+ * @param channel the channel it writes, the source is its write thread.
+ * @param fd the file descriptor.
+ * @param mode sourceReadv or sourceRecvmmsg.
+ * @param batch the most buffers filled by one poll.
+ * @return the source, NULL on failure (EINVAL if the buffers of the channel
+ * cannot hold an IoBuffer and some data).
+ */
+FdSource * createFdSource(BufferChannel * const channel, int const fd,
+        FdSourceMode const mode, int const batch);
+
+/** @return the data capacity of a buffer of the source. */
+size_t fdSourceCapacity(FdSource const * const source);
+
+/**
+ * Reads what the descriptor has, with one system call, and sends it.
+ * On a blocking descriptor it waits for the first bytes or message.
+ * If the channel takes fewer buffers than were filled the others go back into
+ * the pool and are counted by 'fdSourceDropped'.
+ * @return the number of buffers sent, 0 if there was nothing to read or no
+ * free buffer, -1 on failure with errno from the system call (EAGAIN for an
+ * empty non blocking descriptor) or, if the channel took none of the filled
+ * buffers, from 'channelSendItems' (ENOMEM if its queue is full, EPIPE if it
+ * is closed).
+ */
+int fdSourcePoll(FdSource * const source);
+
+/** @return 1 if a read found the end of the file, 0 otherwise. */
+int fdSourceEnded(FdSource const * const source);
+
+/** @return the filled buffers the channel did not take, their data is lost. */
+unsigned long fdSourceDropped(FdSource const * const source);
+
+/** Releases the source, the channel stays. */
+void destroyFdSource(FdSource * const source);
+
+#endif
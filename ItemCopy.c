@@ -0,0 +1,150 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdint.h>
+
+#include "ItemCopy.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ITEM_COPY_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*CopyFunction)(void ** const dst, void * const * const src, int const count);
+
+static void copyScalarItems(void ** const dst, void * const * const src, int const count) {
+    for (int i = 0; i < count; ++i) dst[i] = src[i];
+}
+
+#ifdef ITEM_COPY_X86
+
+__attribute__((target("sse2")))
+static void copySse2Items(void ** const dst, void * const * const src, int const count) {
+    register int i = 0;
+    for (; i + 2 <= count; i += 2)
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((__m128i const *)(src + i)));
+    if (i < count) dst[i] = src[i];
+}
+
+__attribute__((target("avx2")))
+static void copyAvx2Items(void ** const dst, void * const * const src, int const count) {
+    register int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        register __m256i const a = _mm256_loadu_si256((__m256i const *)(src + i));
+        register __m256i const b = _mm256_loadu_si256((__m256i const *)(src + i + 4));
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+        _mm256_storeu_si256((__m256i *)(dst + i + 4), b);
+    }
+    for (; i + 4 <= count; i += 4)
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_loadu_si256((__m256i const *)(src + i)));
+    for (; i < count; ++i) dst[i] = src[i];
+}
+
+/* The non temporal stores need an aligned destination: the items before the
+ * first aligned one and after the last full vector are stored as usual. */
+
+__attribute__((target("sse2")))
+static void streamSse2Items(void ** const dst, void * const * const src, int const count) {
+    register int i = 0;
+    if (((uintptr_t)dst & 15) && count) {
+        dst[0] = src[0];
+        i = 1;
+    }
+    for (; i + 2 <= count; i += 2)
+        _mm_stream_si128((__m128i *)(dst + i), _mm_loadu_si128((__m128i const *)(src + i)));
+    if (i < count) dst[i] = src[i];
+    _mm_sfence();
+}
+
+__attribute__((target("avx2")))
+static void streamAvx2Items(void ** const dst, void * const * const src, int const count) {
+    register int i = 0;
+    for (; i < count && ((uintptr_t)(dst + i) & 31); ++i) dst[i] = src[i];
+    for (; i + 4 <= count; i += 4)
+        _mm256_stream_si256((__m256i *)(dst + i), _mm256_loadu_si256((__m256i const *)(src + i)));
+    for (; i < count; ++i) dst[i] = src[i];
+    _mm_sfence();
+}
+
+#endif
+
+/** The kernels in use, NULL until the first copy. */
+static CopyFunction volatile copyFunction;
+static CopyFunction volatile streamFunction;
+static CopyKernel volatile kernelInUse;
+
+/** @return true if the CPU has the kernel. */
+static int supported(CopyKernel const kernel) {
+#ifdef ITEM_COPY_X86
+    if (kernel == copyAvx2) return __builtin_cpu_supports("avx2");
+    if (kernel == copySse2) return __builtin_cpu_supports("sse2");
+#endif
+    return kernel == copyScalar;
+}
+
+int itemCopyUse(CopyKernel kernel) {
+    if (kernel == copyAuto)
+        kernel = supported(copyAvx2) ? copyAvx2 : supported(copySse2) ? copySse2 : copyScalar;
+    if (kernel < copyAuto || kernel > copyAvx2) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!supported(kernel)) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    /* A thread racing with us picks the same functions or the old ones,
+     * a pointer is stored at once. */
+    switch (kernel) {
+#ifdef ITEM_COPY_X86
+    case copyAvx2:
+        streamFunction = streamAvx2Items;
+        copyFunction = copyAvx2Items;
+        break;
+    case copySse2:
+        streamFunction = streamSse2Items;
+        copyFunction = copySse2Items;
+        break;
+#endif
+    default:
+        streamFunction = copyScalarItems;
+        copyFunction = copyScalarItems;
+    }
+    kernelInUse = kernel;
+    return 0;
+}
+
+char const * itemCopyName() {
+    if (!copyFunction) itemCopyUse(copyAuto);
+    switch (kernelInUse) {
+    case copyAvx2: return "avx2";
+    case copySse2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+void copyItems(void ** const dst, void * const * const src, int const count) {
+    if (!copyFunction) itemCopyUse(copyAuto);
+    copyFunction(dst, src, count);
+}
+
+void streamItems(void ** const dst, void * const * const src, int const count) {
+    if (!streamFunction) itemCopyUse(copyAuto);
+    streamFunction(dst, src, count);
+}
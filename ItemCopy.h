@@ -0,0 +1,71 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ITEM_COPY_H
+#define ITEM_COPY_H
+
+/**
+ * The copy of many items at once, between the sectors and the arrays of
+ * 'readItems' and 'writeItems'.
+ *
+ * The kernel is picked the first time it is needed, the widest the CPU
+ * has: AVX2 moves 4 items per instruction, SSE2 2 and the scalar loop 1.
+ *
+ * The streaming copy writes with non temporal stores, that go to the memory
+ * without taking the destination into the cache. It is for batches much
+ * larger then the cache, that would otherwise push out the data in use. It
+ * ends with a store fence, so the items are visible to the other threads
+ * before anything stored after the copy, as the queue needs before moving a
+ * cursor.
+ */
+
+/** The kernels. */
+typedef enum CopyKernel {
+    /** The widest one the CPU has. */
+    copyAuto,
+    copyScalar,
+    copySse2,
+    copyAvx2
+} CopyKernel;
+
+/** Below that many items a plain loop is as fast as any kernel. */
+#define ITEM_COPY_MIN 8
+
+/**
+ * Forces a kernel, for tests and benchmarks.
+ * @return On success 0, -1 otherwise (ENOTSUP if the CPU does not have it).
+ */
+int itemCopyUse(CopyKernel const kernel);
+
+/** @return the name of the kernel in use. */
+char const * itemCopyName();
+
+/**
+ * Copies count pointers from src to dst, the two do not overlap.
+ */
+void copyItems(void ** const dst, void * const * const src, int const count);
+
+/**
+ * Copies count pointers from src to dst with non temporal stores and a store
+ * fence after them.
+ */
+void streamItems(void ** const dst, void * const * const src, int const count);
+
+#endif
@@ -0,0 +1,206 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "LatencyTrace.h"
+
+#define LATENCY_TRACE_LINE 64
+
+typedef struct Stamp {
+    unsigned long sequence;
+    unsigned long ticks;
+} Stamp;
+
+struct LatencyTrace {
+    int every;
+    unsigned long mask;
+    double nsPerTick;
+    Stamp volatile * stamps;
+    /** Handled only by the write thread. */
+    unsigned long written __attribute__((aligned(LATENCY_TRACE_LINE)));
+    /** The sequence number of the item stamped but not yet written, 0 if none. */
+    unsigned long pending;
+    /** The stamps put in the ring, written only by the write thread. */
+    unsigned long volatile stamped;
+    /** The items not stamped because the ring was full. */
+    unsigned long volatile missed;
+    /** Handled only by the read thread. */
+    unsigned long read __attribute__((aligned(LATENCY_TRACE_LINE)));
+    /** The stamps taken from the ring, written only by the read thread. */
+    unsigned long volatile measured;
+    /** The stamps taken from the ring and added to the histogram. */
+    unsigned long volatile counted;
+    /** The stamps dropped because their item was already read. */
+    unsigned long volatile stale;
+    unsigned long volatile minNs;
+    unsigned long volatile maxNs;
+    unsigned long volatile totalNs;
+    unsigned long volatile buckets[LATENCY_BUCKETS];
+};
+
+static inline unsigned long readTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ul + now.tv_nsec;
+#endif
+}
+
+static unsigned long monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ul + now.tv_nsec;
+}
+
+/** Counts the ticks of a 10ms interval. */
+static double calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+    register unsigned long const startNs = monotonicNs();
+    register unsigned long const startTicks = readTicks();
+    register unsigned long ns;
+    do {
+        ns = monotonicNs();
+    } while (ns - startNs < 10000000ul);
+    return (double)(readTicks() - startTicks) / (ns - startNs);
+#else
+    return 1;
+#endif
+}
+
+static int bucketOf(unsigned long const ns) {
+    if (ns < 1ul << LATENCY_SUB_BITS) return ns;
+    register int const power = 63 - __builtin_clzl(ns);
+    register int const sub = (ns >> (power - LATENCY_SUB_BITS))
+        & ((1 << LATENCY_SUB_BITS) - 1);
+    return ((power - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+unsigned long latencyBucketLow(int const bucket) {
+    if (bucket < 1 << LATENCY_SUB_BITS) return bucket;
+    register int const power = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    register unsigned long const sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+    return ((1ul << LATENCY_SUB_BITS) + sub) << (power - LATENCY_SUB_BITS);
+}
+
+LatencyTrace * createLatencyTrace(TraceConfig const * const config) {
+    if (!config || config->every <= 0 || config->stamps <= 0
+            || config->stamps & (config->stamps - 1) || config->ticksPerNs < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    LatencyTrace * trace;
+    if (posix_memalign((void **)&trace, LATENCY_TRACE_LINE, sizeof(LatencyTrace))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(trace, 0, sizeof(LatencyTrace));
+    trace->stamps = malloc(sizeof(Stamp) * config->stamps);
+    if (!trace->stamps) {
+        free(trace);
+        errno = ENOMEM;
+        return NULL;
+    }
+    trace->every = config->every;
+    trace->mask = config->stamps - 1;
+    trace->nsPerTick = 1 / (config->ticksPerNs ? config->ticksPerNs : calibrate());
+    trace->minNs = ~0ul;
+    return trace;
+}
+
+int tracedWriteItem(LatencyTrace * const trace, Queue * const queue, void * const item) {
+    if (!trace || !queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    register unsigned long const sequence = trace->written + 1;
+    if (trace->pending != sequence && !(sequence % trace->every)) {
+        if (trace->stamped - trace->measured <= trace->mask) {
+            register Stamp volatile * const stamp = &trace->stamps[trace->stamped & trace->mask];
+            stamp->sequence = sequence;
+            stamp->ticks = readTicks();
+            ++trace->stamped;
+        } else {
+            ++trace->missed;
+        }
+        trace->pending = sequence;
+    }
+    if (writeItem(queue, item)) return -1;
+    trace->written = sequence;
+    return 0;
+}
+
+void * tracedReadItem(LatencyTrace * const trace, Queue * const queue) {
+    if (!trace || !queue) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register void * const item = readItem(queue);
+    if (!item || item == QUEUE_END) return item;
+    register unsigned long const sequence = ++trace->read;
+    register Stamp volatile * stamp;
+    /* A stamp left behind, by items read around the traced calls, would block the ring. */
+    for (;;) {
+        if (trace->measured == trace->stamped) return item;
+        stamp = &trace->stamps[trace->measured & trace->mask];
+        if (stamp->sequence >= sequence) break;
+        ++trace->stale;
+        ++trace->measured;
+    }
+    if (stamp->sequence != sequence) return item;
+    register unsigned long const ns = (readTicks() - stamp->ticks) * trace->nsPerTick;
+    ++trace->buckets[bucketOf(ns)];
+    trace->totalNs += ns;
+    if (ns < trace->minNs) trace->minNs = ns;
+    if (ns > trace->maxNs) trace->maxNs = ns;
+    ++trace->counted;
+    ++trace->measured;
+    return item;
+}
+
+void latencySnapshot(LatencyTrace const * const trace, LatencySnapshot * const snapshot) {
+    if (!trace || !snapshot) return;
+    snapshot->count = trace->counted;
+    snapshot->missed = trace->missed;
+    snapshot->stale = trace->stale;
+    snapshot->minNs = trace->counted ? trace->minNs : 0;
+    snapshot->maxNs = trace->maxNs;
+    snapshot->totalNs = trace->totalNs;
+    for (int b = 0; b < LATENCY_BUCKETS; ++b) snapshot->buckets[b] = trace->buckets[b];
+}
+
+unsigned long latencyPercentile(LatencySnapshot const * const snapshot, double const fraction) {
+    register unsigned long seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+        seen += snapshot->buckets[b];
+        if (seen && seen >= fraction * snapshot->count)
+            return b + 1 < LATENCY_BUCKETS ? latencyBucketLow(b + 1) : ~0ul;
+    }
+    return 0;
+}
+
+void destroyLatencyTrace(LatencyTrace * const trace) {
+    if (!trace) return;
+    free((void *)trace->stamps);
+    free(trace);
+}
@@ -0,0 +1,126 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include "TransThread.h"
+
+/** The linear sub buckets of every power of 2 of the histogram, as bits. */
+#define LATENCY_SUB_BITS 3
+
+/** The number of buckets of the histogram, enough for any 64 bit value. */
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+/** How a queue is traced. */
+typedef struct TraceConfig {
+    /** Every how many items one is stamped, 1 stamps all of them. */
+    int every;
+    /** The number of stamps in flight, a power of 2. */
+    int stamps;
+    /**
+     * The time stamp counter ticks per nanosecond, 0 to measure it at
+     * creation against CLOCK_MONOTONIC.
+     */
+    double ticksPerNs;
+} TraceConfig;
+
+/**
+ * The time the stamped items spent in the queue, in nanoseconds.
+ * Bucket b counts the times from 'latencyBucketLow(b)' up to the low bound of
+ * the next bucket.
+ */
+typedef struct LatencySnapshot {
+    unsigned long count;
+    /** The items that were not stamped because all the stamps were in flight. */
+    unsigned long missed;
+    /**
+     * The stamps dropped because their item was read without 'tracedReadItem'
+     * before it, or the count of the read thread fell out of step.
+     */
+    unsigned long stale;
+    unsigned long minNs;
+    unsigned long maxNs;
+    unsigned long totalNs;
+    unsigned long buckets[LATENCY_BUCKETS];
+} LatencySnapshot;
+
+/**
+ * The enqueue to dequeue latency of one queue, measured on a sample of its
+ * items.
+ *
+ * The write thread writes through 'tracedWriteItem': before every "every"-th
+ * item it puts the sequence number of the item and the time stamp counter into
+ * a small ring of stamps. The read thread reads through 'tracedReadItem' and
+ * counts the items it got; when the count reaches the sequence number of the
+ * oldest stamp it takes the stamp and adds the time since then to the
+ * histogram. Stamps whose sequence number it already passed are dropped and
+ * counted as stale.
+ *
+ * A stamp is taken before the first try to write the item, so the time spent
+ * waiting for room in a full queue is counted too.
+ *
+ * Nothing of this touches 'writeItem' or 'readItem', a queue used without the
+ * traced calls costs the same as before.
+ */
+typedef struct LatencyTrace LatencyTrace;
+
+/**
+ * Creates a trace.
+ * @return the trace, NULL on failure (EINVAL, ENOMEM).
+ */
+LatencyTrace * createLatencyTrace(TraceConfig const * const config);
+
+/**
+ * Writes an item with 'writeItem', stamping it if its turn came.
+ * Called by the write thread.
+ * @return as 'writeItem', -1 also on invalid arguments (EINVAL).
+ */
+int tracedWriteItem(LatencyTrace * const trace, Queue * const queue, void * const item);
+
+/**
+ * Reads an item with 'readItem', measuring it if it was stamped.
+ * Called by the read thread.
+ * @return as 'readItem': the item, NULL if the queue is empty, QUEUE_END if
+ * it is closed and drained, which is not counted; NULL also on invalid
+ * arguments (EINVAL).
+ */
+void * tracedReadItem(LatencyTrace * const trace, Queue * const queue);
+
+/**
+ * Copies the histogram, from any thread; nothing is done if an argument is NULL.
+ * Taken while the read thread works, the counters may be off by the items
+ * measured meanwhile.
+ */
+void latencySnapshot(LatencyTrace const * const trace, LatencySnapshot * const snapshot);
+
+/** @return the lowest time, in nanoseconds, that goes into bucket. */
+unsigned long latencyBucketLow(int const bucket);
+
+/**
+ * @return the time, in nanoseconds, under which fall the given fraction of
+ * the measured items, with the precision of the buckets.
+ */
+unsigned long latencyPercentile(LatencySnapshot const * const snapshot, double const fraction);
+
+/** Releases the trace. */
+void destroyLatencyTrace(LatencyTrace * const trace);
+
+#endif
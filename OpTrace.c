@@ -0,0 +1,225 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "OpTrace.h"
+
+#define OP_TRACE_MAGIC "TTOPTRC1"
+
+struct OpRecorder {
+    OpRole role;
+    size_t capacity;
+    size_t used;
+    unsigned long dropped;
+    OpEvent * events;
+};
+
+/** The start of a trace file, followed by the events. */
+typedef struct OpTraceHeader {
+    char magic[8];
+    uint64_t count;
+} OpTraceHeader;
+
+OpRecorder * createOpRecorder(OpRole const role, size_t const capacity) {
+    if ((role != opWriter && role != opReader) || !capacity) {
+        errno = EINVAL;
+        return NULL;
+    }
+    OpRecorder * const recorder = malloc(sizeof(OpRecorder));
+    if (!recorder) return NULL;
+    recorder->events = malloc(sizeof(OpEvent) * capacity);
+    if (!recorder->events) {
+        free(recorder);
+        errno = ENOMEM;
+        return NULL;
+    }
+    /* Touch the pages now, not while recording. */
+    memset(recorder->events, 0, sizeof(OpEvent) * capacity);
+    recorder->role = role;
+    recorder->capacity = capacity;
+    recorder->used = 0;
+    recorder->dropped = 0;
+    return recorder;
+}
+
+void opRecord(OpRecorder * const recorder, OpCode const op, uint32_t const count) {
+    if (recorder->used == recorder->capacity) {
+        ++recorder->dropped;
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    register OpEvent * const event = &recorder->events[recorder->used++];
+    event->ns = now.tv_sec * 1000000000ull + now.tv_nsec;
+    event->op = op;
+    event->role = recorder->role;
+    event->count = count;
+}
+
+int opWriteItem(OpRecorder * const recorder, Queue * const queue, void * const item) {
+    if (writeItem(queue, item)) {
+        register int const error = errno;
+        opRecord(recorder, opFull, 1);
+        errno = error;
+        return -1;
+    }
+    opRecord(recorder, opWrite, 1);
+    return 0;
+}
+
+int opWriteItems(OpRecorder * const recorder, Queue * const queue,
+        void * const * const items, int const count) {
+    register int const written = writeItems(queue, items, count);
+    if (written < 0) return written;
+    register int const error = errno;
+    if (written) opRecord(recorder, opWrite, written);
+    if (written < count) opRecord(recorder, opFull, count - written);
+    errno = error;
+    return written;
+}
+
+void * opReadItem(OpRecorder * const recorder, Queue * const queue) {
+    register void * const item = readItem(queue);
+    /* The end of a closed queue reads as empty. */
+    register int const read = item && item != QUEUE_END;
+    opRecord(recorder, read ? opRead : opEmpty, read);
+    return item;
+}
+
+int opReadItems(OpRecorder * const recorder, Queue * const queue, void ** const items,
+        int const count) {
+    register int const got = readItems(queue, items, count);
+    if (got < 0) {
+        register int const error = errno;
+        if (error == EPIPE) opRecord(recorder, opEmpty, 0);
+        errno = error;
+        return got;
+    }
+    opRecord(recorder, got ? opRead : opEmpty, got);
+    return got;
+}
+
+int opSubmitSector(OpRecorder * const recorder, Queue * const queue, void * const mem,
+        size_t const size) {
+    if (submitSector(queue, mem, size)) return -1;
+    opRecord(recorder, opSubmit, size);
+    return 0;
+}
+
+struct QueueSector * opRecoverSector(OpRecorder * const recorder, Queue * const queue) {
+    register struct QueueSector * const sector = recoverSector(queue);
+    /* The number of items is the first field of the sector. */
+    if (sector)
+        opRecord(recorder, opRecover, QUEUE_HANDLE_SECTOR_SIZE(*(int *)sector,
+                    queue->handleWidth ? queue->handleWidth : (int)sizeof(void *)));
+    return sector;
+}
+
+unsigned long opRecorderDropped(OpRecorder const * const recorder) {
+    return recorder->dropped;
+}
+
+int opTraceDump(char const * const path, OpRecorder * const * const recorders,
+        int const count) {
+    if (!path || !recorders || count <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    register uint64_t end = UINT64_MAX;
+    for (int r = 0; r < count; ++r)
+        if (recorders[r]->dropped && recorders[r]->used
+                && recorders[r]->events[recorders[r]->used - 1].ns < end)
+            end = recorders[r]->events[recorders[r]->used - 1].ns;
+    size_t * const next = calloc(count, sizeof(size_t));
+    if (!next) return -1;
+    FILE * const file = fopen(path, "wb");
+    if (!file) {
+        free(next);
+        return -1;
+    }
+    OpTraceHeader header;
+    memcpy(header.magic, OP_TRACE_MAGIC, sizeof(header.magic));
+    header.count = 0;
+    register int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    for (;;) {
+        register int best = -1;
+        for (int r = 0; r < count; ++r)
+            if (next[r] < recorders[r]->used && recorders[r]->events[next[r]].ns <= end
+                    && (best < 0 || recorders[r]->events[next[r]].ns
+                        < recorders[best]->events[next[best]].ns))
+                best = r;
+        if (best < 0) break;
+        failed |= fwrite(&recorders[best]->events[next[best]++], sizeof(OpEvent), 1, file) != 1;
+        ++header.count;
+    }
+    failed |= fseek(file, 0, SEEK_SET) || fwrite(&header, sizeof(header), 1, file) != 1;
+    failed |= fclose(file) != 0;
+    free(next);
+    return failed ? -1 : 0;
+}
+
+OpTrace * opTraceLoad(char const * const path) {
+    FILE * const file = fopen(path, "rb");
+    if (!file) return NULL;
+    OpTraceHeader header;
+    struct stat status;
+    /* The count must fit the file, so a damaged one cannot make us allocate or read too much. */
+    if (fread(&header, sizeof(header), 1, file) != 1
+            || memcmp(header.magic, OP_TRACE_MAGIC, sizeof(header.magic))
+            || fstat(fileno(file), &status)
+            || header.count > (status.st_size - sizeof(header)) / sizeof(OpEvent)) {
+        fclose(file);
+        errno = EINVAL;
+        return NULL;
+    }
+    OpTrace * const trace = malloc(sizeof(OpTrace));
+    if (trace) trace->events = malloc(sizeof(OpEvent) * (header.count ? header.count : 1));
+    if (!trace || !trace->events) {
+        free(trace);
+        fclose(file);
+        errno = ENOMEM;
+        return NULL;
+    }
+    trace->count = header.count;
+    if (fread(trace->events, sizeof(OpEvent), header.count, file) != header.count) {
+        destroyOpTrace(trace);
+        fclose(file);
+        errno = EINVAL;
+        return NULL;
+    }
+    fclose(file);
+    return trace;
+}
+
+void destroyOpTrace(OpTrace * const trace) {
+    if (!trace) return;
+    free(trace->events);
+    free(trace);
+}
+
+void destroyOpRecorder(OpRecorder * const recorder) {
+    if (!recorder) return;
+    free(recorder->events);
+    free(recorder);
+}
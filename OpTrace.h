@@ -0,0 +1,132 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef OP_TRACE_H
+#define OP_TRACE_H
+
+#include <stdint.h>
+
+#include "TransThread.h"
+
+/** The operations that are recorded. */
+typedef enum OpCode {
+    /** Items written, count of them. */
+    opWrite,
+    /** Items read, count of them. */
+    opRead,
+    /** A write that found the queue full, count items were not written. */
+    opFull,
+    /** A read that found the queue empty. */
+    opEmpty,
+    /** A sector submitted, count bytes. */
+    opSubmit,
+    /** A sector recovered, count bytes, the part of it the queue used. */
+    opRecover
+} OpCode;
+
+/** The thread that recorded an operation. */
+typedef enum OpRole {
+    opWriter,
+    opReader
+} OpRole;
+
+/** One recorded operation, as it is kept in memory and in the file. */
+typedef struct OpEvent {
+    /** CLOCK_MONOTONIC, in nanoseconds. */
+    uint64_t ns;
+    uint16_t op;
+    uint16_t role;
+    uint32_t count;
+} OpEvent;
+
+/**
+ * The operations of one thread on one queue, in a buffer allocated up front.
+ * It does not wrap: once the buffer is full the later operations are dropped
+ * and only counted, see 'opRecorderDropped', so what is kept is the beginning
+ * of the run, which is what a replay needs.
+ * A recorder is used by its thread only, until it is dumped.
+ */
+typedef struct OpRecorder OpRecorder;
+
+/** A trace loaded from a file, the operations of all the threads by time. */
+typedef struct OpTrace {
+    uint64_t count;
+    OpEvent * events;
+} OpTrace;
+
+/**
+ * Creates a recorder for the write or the read thread of a queue.
+ * @param role opWriter or opReader.
+ * @param capacity the number of operations it keeps.
+ * @return the recorder, NULL on failure.
+ */
+OpRecorder * createOpRecorder(OpRole const role, size_t const capacity);
+
+/** Records an operation, with the time of now. */
+void opRecord(OpRecorder * const recorder, OpCode const op, uint32_t const count);
+
+/** 'writeItem' recording opWrite or opFull. */
+int opWriteItem(OpRecorder * const recorder, Queue * const queue, void * const item);
+
+/** 'writeItems' recording opWrite and opFull for the items left out. */
+int opWriteItems(OpRecorder * const recorder, Queue * const queue,
+        void * const * const items, int const count);
+
+/** 'readItem' recording opRead, or opEmpty for NULL and QUEUE_END. */
+void * opReadItem(OpRecorder * const recorder, Queue * const queue);
+
+/** 'readItems' recording opRead, or opEmpty for 0 and the end of a closed queue. */
+int opReadItems(OpRecorder * const recorder, Queue * const queue, void ** const items,
+        int const count);
+
+/** 'submitSector' recording opSubmit. */
+int opSubmitSector(OpRecorder * const recorder, Queue * const queue, void * const mem,
+        size_t const size);
+
+/** 'recoverSector' recording opRecover. */
+struct QueueSector * opRecoverSector(OpRecorder * const recorder, Queue * const queue);
+
+/** @return the operations that did not fit in the recorder. */
+unsigned long opRecorderDropped(OpRecorder const * const recorder);
+
+/**
+ * Writes the operations of the recorders into a file, merged by time.
+ * If a recorder got full the trace ends where that recorder stopped, so all the
+ * threads cover the same span of time.
+ * Must be called when the threads no longer record.
+ * @return On success 0, -1 otherwise with errno set.
+ */
+int opTraceDump(char const * const path, OpRecorder * const * const recorders,
+        int const count);
+
+/**
+ * Loads a trace written by 'opTraceDump'.
+ * @return the trace, NULL on failure (EINVAL if it is not a trace file or it
+ * holds fewer events than its header counts).
+ */
+OpTrace * opTraceLoad(char const * const path);
+
+/** Releases a trace. */
+void destroyOpTrace(OpTrace * const trace);
+
+/** Releases a recorder. */
+void destroyOpRecorder(OpRecorder * const recorder);
+
+#endif
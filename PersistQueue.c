@@ -0,0 +1,139 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "PersistQueue.h"
+
+/** @return the offset of the sector the cursor of this process is on. */
+static uint64_t cursorSector(PersistQueue const * const queue) {
+    register ShmQueueHeader const * const header = (ShmQueueHeader const *)queue->shm.base;
+    return queue->shm.role == shmWriter ? header->write : header->read;
+}
+
+/** Locks the byte of the role, held for as long as the file is open. */
+static int lockRole(int const fd, ShmRole const role) {
+    struct flock lock;
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = role;
+    lock.l_len = 1;
+    lock.l_pid = 0;
+    if (!fcntl(fd, F_OFD_SETLK, &lock)) return 0;
+    if (errno == EAGAIN || errno == EACCES) errno = EBUSY;
+    return -1;
+}
+
+int persistQueueOpen(PersistQueue * const queue, char const * const path,
+        ShmRole const role, int const sectors, int const itemsPerSector,
+        PersistSync const sync, int const batch) {
+    if (!queue || !path || (role != shmWriter && role != shmReader)
+            || (sync == persistBatch && batch <= 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    *queue = mkPersistQueue();
+    register int const fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    struct stat st;
+    /* Only one process lays out a new file. */
+    register int failed = flock(fd, LOCK_EX) || fstat(fd, &st);
+    if (!failed && !st.st_size) {
+        failed = shmQueueCreate(&queue->shm, fd, sectors, itemsPerSector)
+            || (sync != persistNone && (msync(queue->shm.base, queue->shm.size, MS_SYNC)
+                    || fsync(fd)));
+    } else if (!failed) {
+        failed = shmQueueAttach(&queue->shm, fd);
+    }
+    /* Holding the lock of the role, whoever had it before is gone. */
+    failed = failed || lockRole(fd, role) || shmQueueTakeOver(&queue->shm, role);
+    register int const error = errno;
+    flock(fd, LOCK_UN);
+    if (failed) {
+        if (queue->shm.base) shmQueueDetach(&queue->shm);
+        close(fd);
+        *queue = mkPersistQueue();
+        errno = error;
+        return -1;
+    }
+    queue->fd = fd;
+    queue->sync = sync;
+    queue->batch = batch;
+    queue->sector = cursorSector(queue);
+    return 0;
+}
+
+/** Syncs if the policy says so, after an operation. */
+static int maybeSync(PersistQueue * const queue) {
+    if (queue->sync == persistBatch && ++queue->unsynced >= queue->batch)
+        return persistQueueSync(queue);
+    if (queue->sync == persistSector && cursorSector(queue) != queue->sector)
+        return persistQueueSync(queue);
+    return 0;
+}
+
+int persistWriteItem(PersistQueue * const queue, uint64_t const item) {
+    if (!queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (shmWriteItem(&queue->shm, item)) return -1;
+    return maybeSync(queue);
+}
+
+int persistReadItem(PersistQueue * const queue, uint64_t * const item) {
+    if (!queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (shmReadItem(&queue->shm, item)) return -1;
+    return maybeSync(queue);
+}
+
+int persistQueueSync(PersistQueue * const queue) {
+    if (!queue || !queue->shm.base) {
+        errno = EINVAL;
+        return -1;
+    }
+    queue->unsynced = 0;
+    queue->sector = cursorSector(queue);
+    /* The sectors, then the page of the header: its cursors never get ahead. */
+    register size_t const page = sysconf(_SC_PAGESIZE);
+    if (queue->shm.size > page
+            && msync(queue->shm.base + page, queue->shm.size - page, MS_SYNC))
+        return -1;
+    return msync(queue->shm.base, queue->shm.size < page ? queue->shm.size : page, MS_SYNC);
+}
+
+int persistQueueClose(PersistQueue * const queue) {
+    if (!queue || !queue->shm.base) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int failed = queue->sync != persistNone && persistQueueSync(queue);
+    failed |= shmQueueDetach(&queue->shm) != 0;
+    failed |= close(queue->fd) != 0;
+    *queue = mkPersistQueue();
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,121 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PERSIST_QUEUE_H
+#define PERSIST_QUEUE_H
+
+#include "ShmQueue.h"
+
+/** When the memory of a persistent queue is written to the disk. */
+typedef enum PersistSync {
+    /** Only when the kernel decides, the queue survives the process but not the machine. */
+    persistNone,
+    /** After every "batch" operations of the thread. */
+    persistBatch,
+    /** Every time the thread moves to another sector. */
+    persistSector
+} PersistSync;
+
+/**
+ * A queue kept in a regular file, so its items survive the restart of the
+ * processes.
+ *
+ * It is the shared memory queue of ShmQueue.h mapped from a file: the items
+ * are written before the write cursors, the read cursors move after the items
+ * are taken and a recycle of a sector is journaled in the header. A process
+ * that opens the file finds the queue as the last process left it; a write
+ * process that died in the middle of a recycle is fixed up by the next one.
+ *
+ * Every role is held with a lock on the file, so a role left by a dead
+ * process is taken over even if its pid was reused after a restart.
+ *
+ * The queue on the disk is the queue as of the last sync: everything done
+ * before a sync is on the disk after it returns. A sync writes the sectors
+ * first and the first page, with the header and its cursors, last, so a crash
+ * in the middle of a sync leaves the header of the sync before over items
+ * that are all there. In between syncs the kernel may still write back any
+ * page on its own, a cursor before the items it covers too, so after a crash
+ * of the machine the operations since the last sync are lost or only partly
+ * there. The sync policy only sets how often the sync happens: after "batch"
+ * operations with persistBatch, on every sector with persistSector.
+ */
+typedef struct PersistQueue {
+    ShmQueue shm;
+    int fd;
+    PersistSync sync;
+    int batch;
+    /** The operations since the last sync. */
+    int unsynced;
+    /** The sector of the cursor of this process at the last sync. */
+    uint64_t sector;
+} PersistQueue;
+
+/** Creates a handle that is not open. */
+static inline PersistQueue mkPersistQueue() {
+    PersistQueue const tmp = {{NULL, 0, shmNone}, -1, persistNone, 0, 0, 0};
+    return tmp;
+}
+
+/**
+ * Opens the queue of a file in a role, creating it if the file is new or
+ * empty. The shape of an existing queue is kept, sectors and itemsPerSector
+ * are used only at creation.
+ * @param queue the handle to fill.
+ * @param path the file.
+ * @param role shmWriter or shmReader.
+ * @param sectors the number of sectors, at least 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @param sync the sync policy of this process.
+ * @param batch the operations between syncs for persistBatch.
+ * @return On success 0, -1 otherwise (EBUSY if a live process has the role,
+ * EINVAL if the file holds something else).
+ */
+int persistQueueOpen(PersistQueue * const queue, char const * const path,
+        ShmRole const role, int const sectors, int const itemsPerSector,
+        PersistSync const sync, int const batch);
+
+/**
+ * Writes a value, then syncs if the policy says so.
+ * @return On success 0, -1 otherwise (ENOMEM if the queue is full, or the
+ * error of the sync, the value is written then).
+ */
+int persistWriteItem(PersistQueue * const queue, uint64_t const item);
+
+/**
+ * Reads a value, then syncs if the policy says so.
+ * @return On success 0, -1 otherwise (EAGAIN if the queue is empty, or the
+ * error of the sync, the value is taken then).
+ */
+int persistReadItem(PersistQueue * const queue, uint64_t * const item);
+
+/**
+ * Writes the memory of the queue to the disk now.
+ * @return On success 0, -1 otherwise.
+ */
+int persistQueueSync(PersistQueue * const queue);
+
+/**
+ * Syncs, unless the policy is persistNone, gives back the role and closes the
+ * file.
+ * @return On success 0, -1 otherwise.
+ */
+int persistQueueClose(PersistQueue * const queue);
+
+#endif
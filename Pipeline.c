@@ -0,0 +1,256 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Pipeline.h"
+
+/** The size of a cache line, used to keep the threads off each other's data. */
+#define PIPELINE_LINE 64
+
+typedef struct PipelineStage {
+    pthread_t thread;
+    Pipeline * pipeline;
+    StageFunction function;
+    void * context;
+    int cpu;
+    /** The queue from the previous stage (or from the pushing thread). */
+    Queue input;
+    /** The input of the next stage, NULL for the last stage. */
+    Queue * output;
+    /**
+     * The counters are written only by the stage thread.
+     * itemsOut is updated before itemsIn, so when itemsIn covers an item the
+     * items made from it are already counted in itemsOut.
+     */
+    unsigned long volatile batches;
+    unsigned long volatile itemsIn;
+    unsigned long volatile itemsOut;
+    unsigned long long volatile busyNs;
+    unsigned long long volatile blockedNs;
+} __attribute__((aligned(PIPELINE_LINE))) PipelineStage;
+
+struct Pipeline {
+    PipelineConfig config;
+    PipelineStage ** stages;
+    int count;
+    int started;
+    /** Set by 'destroyPipeline' to make the stages exit when idle. */
+    int volatile stop;
+    /** Written only by the pushing thread. */
+    unsigned long pushed;
+    unsigned long long startNs;
+    /** The memory of all the sectors. */
+    void * sectors;
+};
+
+static unsigned long long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void * stageMain(void * const arg) {
+    register PipelineStage * const self = arg;
+    register Pipeline * const pipeline = self->pipeline;
+    register int const batch = pipeline->config.batch;
+    void ** const in = malloc(sizeof(void*) * batch * 2);
+    if (!in) abort();
+    void ** const out = self->output ? in + batch : NULL;
+    for (;;) {
+        register int const count = readItems(&self->input, in, batch);
+        if (count <= 0) {
+            if (pipeline->stop) break;
+            sched_yield();
+            continue;
+        }
+        register unsigned long long const begin = nowNs();
+        register int const emitted = self->function(in, count, out, self->context);
+        register unsigned long long const end = nowNs();
+        self->busyNs += end - begin;
+        if (out && emitted > 0) {
+            register int done = writeItems(self->output, out, emitted);
+            if (done < emitted) {
+                while (done < emitted) {
+                    sched_yield();
+                    done += writeItems(self->output, out + done, emitted - done);
+                }
+                self->blockedNs += nowNs() - end;
+            }
+            self->itemsOut += emitted;
+        }
+        ++self->batches;
+        self->itemsIn += count;
+    }
+    free(in);
+    return NULL;
+}
+
+Pipeline * createPipeline(PipelineConfig const * const config) {
+    if (!config || config->sectorsPerQueue < 2 || config->itemsPerSector <= 0
+            || config->batch <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    Pipeline * const pipeline = calloc(1, sizeof(Pipeline));
+    if (!pipeline) return NULL;
+    pipeline->config = *config;
+    return pipeline;
+}
+
+int pipelineAddStage(Pipeline * const pipeline, StageFunction const function,
+        void * const context, int const cpu) {
+    if (!pipeline || !function || pipeline->started) {
+        errno = EINVAL;
+        return -1;
+    }
+    PipelineStage ** const stages = realloc(pipeline->stages,
+            sizeof(PipelineStage*) * (pipeline->count + 1));
+    if (!stages) return -1;
+    pipeline->stages = stages;
+    PipelineStage * stage;
+    if (posix_memalign((void**)&stage, PIPELINE_LINE, sizeof(PipelineStage))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(stage, 0, sizeof(PipelineStage));
+    stage->pipeline = pipeline;
+    stage->function = function;
+    stage->context = context;
+    stage->cpu = cpu;
+    stage->input = mkQueue();
+    stages[pipeline->count++] = stage;
+    return 0;
+}
+
+int pipelineStart(Pipeline * const pipeline) {
+    if (!pipeline || pipeline->started || !pipeline->count) {
+        errno = EINVAL;
+        return -1;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(pipeline->config.itemsPerSector)
+            + PIPELINE_LINE - 1) / PIPELINE_LINE * PIPELINE_LINE;
+    if (posix_memalign(&pipeline->sectors, PIPELINE_LINE,
+                sectorSize * pipeline->config.sectorsPerQueue * pipeline->count)) {
+        errno = ENOMEM;
+        return -1;
+    }
+    register char * sector = pipeline->sectors;
+    for (int s = 0; s < pipeline->count; ++s) {
+        register PipelineStage * const stage = pipeline->stages[s];
+        for (int i = 0; i < pipeline->config.sectorsPerQueue; ++i, sector += sectorSize)
+            submitSector(&stage->input, sector, sectorSize);
+        stage->output = s + 1 < pipeline->count ? &pipeline->stages[s + 1]->input : NULL;
+    }
+    pipeline->startNs = nowNs();
+    for (int s = 0; s < pipeline->count; ++s) {
+        register PipelineStage * const stage = pipeline->stages[s];
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (stage->cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(stage->cpu, &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        }
+        register int const error = pthread_create(&stage->thread, &attr, stageMain, stage);
+        pthread_attr_destroy(&attr);
+        if (error) {
+            pipeline->stop = 1;
+            for (int i = 0; i < s; ++i) pthread_join(pipeline->stages[i]->thread, NULL);
+            pipeline->stop = 0;
+            free(pipeline->sectors);
+            pipeline->sectors = NULL;
+            for (int i = 0; i < pipeline->count; ++i)
+                pipeline->stages[i]->input = mkQueue();
+            errno = error;
+            return -1;
+        }
+    }
+    pipeline->started = 1;
+    return 0;
+}
+
+int pipelinePush(Pipeline * const pipeline, void * const item) {
+    if (!pipeline || !pipeline->started || !item) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (writeItem(&pipeline->stages[0]->input, item)) return -1;
+    ++pipeline->pushed;
+    return 0;
+}
+
+int pipelinePushBatch(Pipeline * const pipeline, void * const * const items,
+        int const count) {
+    if (!pipeline || !pipeline->started) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int const done = writeItems(&pipeline->stages[0]->input, items, count);
+    if (done > 0) pipeline->pushed += done;
+    return done;
+}
+
+void pipelineFlush(Pipeline * const pipeline) {
+    if (!pipeline || !pipeline->started) return;
+    register unsigned long upstream = pipeline->pushed;
+    for (int s = 0; s < pipeline->count; ++s) {
+        register PipelineStage const * const stage = pipeline->stages[s];
+        while (stage->itemsIn < upstream) sched_yield();
+        upstream = stage->itemsOut;
+    }
+}
+
+int pipelineStats(Pipeline const * const pipeline, int const stage,
+        StageStats * const stats) {
+    if (!pipeline || stage < 0 || stage >= pipeline->count || !stats) {
+        errno = EINVAL;
+        return -1;
+    }
+    register PipelineStage const * const self = pipeline->stages[stage];
+    stats->batches = self->batches;
+    stats->itemsIn = self->itemsIn;
+    stats->itemsOut = self->itemsOut;
+    stats->busyNs = self->busyNs;
+    stats->blockedNs = self->blockedNs;
+    stats->elapsedNs = pipeline->started ? nowNs() - pipeline->startNs : 0;
+    stats->utilisation = stats->elapsedNs
+        ? (double)stats->busyNs / stats->elapsedNs : 0.0;
+    return 0;
+}
+
+void destroyPipeline(Pipeline * const pipeline) {
+    if (!pipeline) return;
+    if (pipeline->started) {
+        pipelineFlush(pipeline);
+        pipeline->stop = 1;
+        for (int s = 0; s < pipeline->count; ++s)
+            pthread_join(pipeline->stages[s]->thread, NULL);
+    }
+    for (int s = 0; s < pipeline->count; ++s) free(pipeline->stages[s]);
+    free(pipeline->stages);
+    free(pipeline->sectors);
+    free(pipeline);
+}
@@ -0,0 +1,132 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "TransThread.h"
+
+/**
+ * The work of a stage, run on a batch of items taken from the upstream queue.
+ * @param items the batch, all the items that were in the upstream queue up to
+ * the batch size.
+ * @param count the number of items in the batch.
+ * @param out the array where to put the items for the downstream stage, it
+ * has room for a full batch. NULL for the last stage.
+ * @param context the context given to 'pipelineAddStage'.
+ * @return the number of items put in out, 0 for the last stage.
+ */
+typedef int (*StageFunction)(void ** items, int count, void ** out, void * context);
+
+/** How to build a pipeline. */
+typedef struct PipelineConfig {
+    /** The number of sectors in every queue between two stages, at least 2. */
+    int sectorsPerQueue;
+    /** The number of items in every sector. */
+    int itemsPerSector;
+    /** The maximum number of items a stage handles at once. */
+    int batch;
+} PipelineConfig;
+
+/** The counters of a stage, all of them since 'pipelineStart'. */
+typedef struct StageStats {
+    /** The number of batches handled. */
+    unsigned long batches;
+    /** The number of items taken from upstream. */
+    unsigned long itemsIn;
+    /** The number of items given to downstream. */
+    unsigned long itemsOut;
+    /** The time spent in the stage function, in nanoseconds. */
+    unsigned long long busyNs;
+    /** The time spent waiting for room in the downstream queue, in nanoseconds. */
+    unsigned long long blockedNs;
+    /** The time since the pipeline was started, in nanoseconds. */
+    unsigned long long elapsedNs;
+    /** busyNs / elapsedNs, the stage with the biggest one is the bottleneck. */
+    double utilisation;
+} StageStats;
+
+/**
+ * A chain of stages, each one on its own thread, linked by TransThread queues.
+ *
+ * The thread that calls 'pipelinePush' is the write thread of the first queue,
+ * every stage is the read thread of its upstream queue and the write thread
+ * of its downstream queue.
+ */
+typedef struct Pipeline Pipeline;
+
+/**
+ * Creates an empty pipeline.
+ * @param config the pipeline configuration.
+ * @return the pipeline, NULL on failure (EINVAL or ENOMEM).
+ */
+Pipeline * createPipeline(PipelineConfig const * const config);
+
+/**
+ * Adds a stage at the end of the pipeline, before 'pipelineStart'.
+ * @param pipeline the pipeline.
+ * @param function the work of the stage.
+ * @param context the last argument of function.
+ * @param cpu the CPU on which to pin the stage, negative for no pinning.
+ * @return On success 0, -1 otherwise.
+ */
+int pipelineAddStage(Pipeline * const pipeline, StageFunction const function,
+        void * const context, int const cpu);
+
+/**
+ * Allocates the queues and starts the stage threads.
+ * @return On success 0, -1 otherwise.
+ */
+int pipelineStart(Pipeline * const pipeline);
+
+/**
+ * Pushes an item into the first stage.
+ * @return On success 0, -1 otherwise (ENOMEM if the first queue is full).
+ */
+int pipelinePush(Pipeline * const pipeline, void * const item);
+
+/**
+ * Pushes a batch of items into the first stage.
+ * @return the number of items pushed, less then count if the first queue got
+ * full (ENOMEM), -1 on invalid arguments.
+ */
+int pipelinePushBatch(Pipeline * const pipeline, void * const * const items,
+        int const count);
+
+/**
+ * Waits until every pushed item went through all the stages.
+ * Must be called from the pushing thread.
+ */
+void pipelineFlush(Pipeline * const pipeline);
+
+/**
+ * Takes a snapshot of the counters of a stage.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int pipelineStats(Pipeline const * const pipeline, int const stage,
+        StageStats * const stats);
+
+/**
+ * Flushes the pipeline, stops the stage threads and releases everything.
+ * Must be called from the pushing thread.
+ */
+void destroyPipeline(Pipeline * const pipeline);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+
+#include "PriorityLanes.h"
+
+#define PRIORITY_LANES_LINE 64
+
+struct PriorityLanes {
+    int lanes;
+    int weights[PRIORITY_LANES_MAX];
+    Queue queues[PRIORITY_LANES_MAX];
+    void * sectors;
+    /** The items written into every lane, mutated only by the write thread. */
+    unsigned long volatile written[PRIORITY_LANES_MAX]
+        __attribute__((aligned(PRIORITY_LANES_LINE)));
+    /** The items taken from every lane, handled only by the read thread. */
+    unsigned long taken[PRIORITY_LANES_MAX]
+        __attribute__((aligned(PRIORITY_LANES_LINE)));
+    /** The items a lane can still give before a lower lane is owed one. */
+    int credits[PRIORITY_LANES_MAX];
+};
+
+PriorityLanes * createPriorityLanes(int const lanes, int const sectorsPerLane,
+        int const itemsPerSector) {
+    if (lanes <= 0 || lanes > PRIORITY_LANES_MAX || sectorsPerLane < 2
+            || itemsPerSector <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector)
+            + PRIORITY_LANES_LINE - 1) / PRIORITY_LANES_LINE * PRIORITY_LANES_LINE;
+    PriorityLanes * bundle;
+    if (posix_memalign((void **)&bundle, PRIORITY_LANES_LINE, sizeof(PriorityLanes))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (posix_memalign(&bundle->sectors, PRIORITY_LANES_LINE,
+                sectorSize * sectorsPerLane * lanes)) {
+        free(bundle);
+        errno = ENOMEM;
+        return NULL;
+    }
+    bundle->lanes = lanes;
+    register char * sector = bundle->sectors;
+    for (int lane = 0; lane < PRIORITY_LANES_MAX; ++lane) {
+        bundle->weights[lane] = 0;
+        bundle->written[lane] = bundle->taken[lane] = 0;
+        bundle->credits[lane] = 0;
+        bundle->queues[lane] = mkQueue();
+        if (lane >= lanes) continue;
+        for (int s = 0; s < sectorsPerLane; ++s, sector += sectorSize)
+            submitSector(&bundle->queues[lane], sector, sectorSize);
+    }
+    return bundle;
+}
+
+int priorityLaneWeight(PriorityLanes * const bundle, int const lane, int const weight) {
+    if (!bundle || lane < 0 || lane >= bundle->lanes || weight < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    bundle->weights[lane] = bundle->credits[lane] = weight;
+    return 0;
+}
+
+int writePriority(PriorityLanes * const bundle, void * const item, int const lane) {
+    /* A NULL would be counted but read as an empty lane. */
+    if (!bundle || !item || lane < 0 || lane >= bundle->lanes) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (writeItem(&bundle->queues[lane], item)) return -1;
+    ++bundle->written[lane];
+    return 0;
+}
+
+int closePriorityLanes(PriorityLanes * const bundle) {
+    if (!bundle) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* Lane 0 last, the read thread looks only at its flag. */
+    for (int l = bundle->lanes - 1; l >= 0; --l) closeQueue(&bundle->queues[l]);
+    return 0;
+}
+
+void * readPriority(PriorityLanes * const bundle, int * const lane) {
+    if (!bundle) return NULL;
+    /* Read before the counters: once set, they do not move any more. */
+    register int const closed = bundle->queues[0].closed;
+    for (int l = bundle->lanes - 1; l >= 0; --l) {
+        if (bundle->written[l] == bundle->taken[l]) {
+            bundle->credits[l] = bundle->weights[l];
+            continue;
+        }
+        if (bundle->weights[l] && !bundle->credits[l]) {
+            register int lowerBusy = 0;
+            for (int lower = l - 1; lower >= 0 && !lowerBusy; --lower)
+                lowerBusy = bundle->written[lower] != bundle->taken[lower];
+            bundle->credits[l] = bundle->weights[l];
+            /* This lane gave its weight in a row, the lower lanes get a turn. */
+            if (lowerBusy) continue;
+        }
+        register void * const item = readItem(&bundle->queues[l]);
+        if (!item || item == QUEUE_END) continue;
+        ++bundle->taken[l];
+        if (bundle->credits[l]) --bundle->credits[l];
+        if (lane) *lane = l;
+        return item;
+    }
+    if (!closed) return NULL;
+    for (int l = 0; l < bundle->lanes; ++l)
+        if (bundle->written[l] != bundle->taken[l]) return NULL;
+    return QUEUE_END;
+}
+
+void destroyPriorityLanes(PriorityLanes * const bundle) {
+    if (!bundle) return;
+    free(bundle->sectors);
+    free(bundle);
+}
@@ -0,0 +1,91 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PRIORITY_LANES_H
+#define PRIORITY_LANES_H
+
+#include "TransThread.h"
+
+/** The most lanes a bundle can have. */
+#define PRIORITY_LANES_MAX 8
+
+/**
+ * A bundle of queues, the lanes, between one write thread and one read thread.
+ * The higher the lane the higher the priority: the read thread takes from the
+ * highest lane that has items.
+ *
+ * To keep the low lanes from starving every lane has a weight: after that
+ * many items in a row from a lane, if a lower lane has items, the lower lane
+ * gets one item. A weight of 0 means strict priority.
+ *
+ * The write thread counts the items it wrote into every lane, the read thread
+ * counts the items it took. Comparing the two counters tells if a lane has
+ * items without touching its queue, so when only one lane is busy a read
+ * costs a few compares on one cache line more then a 'readItem'.
+ */
+typedef struct PriorityLanes PriorityLanes;
+
+/**
+ * Creates a bundle, every lane with its own sectors.
+ * @param lanes the number of lanes, up to PRIORITY_LANES_MAX.
+ * @param sectorsPerLane the number of sectors of every lane, at least 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @return the bundle, NULL on failure.
+ */
+PriorityLanes * createPriorityLanes(int const lanes, int const sectorsPerLane,
+        int const itemsPerSector);
+
+/**
+ * Sets the weight of a lane, before the threads use the bundle.
+ * The default is 0.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int priorityLaneWeight(PriorityLanes * const bundle, int const lane, int const weight);
+
+/**
+ * Writes an item, not NULL, into a lane.
+ * @return On success 0, -1 otherwise (ENOMEM if the lane is full, EINVAL for
+ * a NULL item or a lane out of range).
+ */
+int writePriority(PriorityLanes * const bundle, void * const item, int const lane);
+
+/**
+ * Closes all the lanes, from the write thread, nothing is written after it.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int closePriorityLanes(PriorityLanes * const bundle);
+
+/**
+ * Reads the next item, from the highest lane with items unless a lower one
+ * is owed an item.
+ * @param bundle the bundle.
+ * @param lane if not NULL receives the lane of the item.
+ * @return the item, NULL if all the lanes are empty, QUEUE_END if the bundle
+ * was closed and all the lanes are drained.
+ */
+void * readPriority(PriorityLanes * const bundle, int * const lane);
+
+/**
+ * Releases the bundle and the sectors.
+ * Must be called when no thread uses the bundle.
+ */
+void destroyPriorityLanes(PriorityLanes * const bundle);
+
+#endif
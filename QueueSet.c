@@ -0,0 +1,189 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "QueueSet.h"
+
+#define QUEUE_SET_LINE 64
+
+struct QueueSet {
+    int count;
+    Queue * queues;
+    int * weights;
+    /** Bit w is set when words[w] may have bits set. */
+    unsigned long volatile summary;
+    /** Bit i % QUEUE_SET_BITS of word i / QUEUE_SET_BITS is set when queue i may have items. */
+    unsigned long volatile * words;
+    /** Where the next scan starts, handled only by the read thread. */
+    int next;
+    void * sectors;
+};
+
+static inline unsigned long bitOf(int const index) {
+    return 1ul << (index % QUEUE_SET_BITS);
+}
+
+/** Marks a queue that just got items, from its write thread. */
+static void markBusy(QueueSet * const set, int const index) {
+    register int const word = index / QUEUE_SET_BITS;
+    /* The item has to be visible before we look at the bit. */
+    __sync_synchronize();
+    if (set->words[word] & bitOf(index)) return;
+    __sync_fetch_and_or(&set->words[word], bitOf(index));
+    if (!(set->summary & bitOf(word)))
+        __sync_fetch_and_or(&set->summary, bitOf(word));
+}
+
+/** Clears the bit of a queue found empty, from the read thread. */
+static void markIdle(QueueSet * const set, int const index) {
+    register int const word = index / QUEUE_SET_BITS;
+    register unsigned long const old =
+        __sync_fetch_and_and(&set->words[word], ~bitOf(index));
+    if (old & ~bitOf(index)) return;
+    __sync_fetch_and_and(&set->summary, ~bitOf(word));
+    /* A write thread may have set a bit of the word just before. */
+    if (set->words[word]) __sync_fetch_and_or(&set->summary, bitOf(word));
+}
+
+/** @return the first queue from "from" on that may have items, -1 if none. */
+static int nextBusy(QueueSet * const set, int const from) {
+    register int word = from / QUEUE_SET_BITS;
+    register unsigned long bits = set->words[word] & (~0ul << (from % QUEUE_SET_BITS));
+    if (bits) return word * QUEUE_SET_BITS + __builtin_ctzl(bits);
+    register unsigned long words = word + 1 < QUEUE_SET_BITS
+        ? set->summary & (~0ul << (word + 1)) : 0;
+    while (words) {
+        word = __builtin_ctzl(words);
+        bits = set->words[word];
+        if (bits) return word * QUEUE_SET_BITS + __builtin_ctzl(bits);
+        words &= words - 1;
+    }
+    return -1;
+}
+
+QueueSet * createQueueSet(int const count, int const sectorsPerQueue,
+        int const itemsPerSector) {
+    if (count <= 0 || count > QUEUE_SET_MAX || sectorsPerQueue < 2
+            || itemsPerSector <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector)
+            + QUEUE_SET_LINE - 1) / QUEUE_SET_LINE * QUEUE_SET_LINE;
+    register int const wordCount = (count + QUEUE_SET_BITS - 1) / QUEUE_SET_BITS;
+    QueueSet * const set = calloc(1, sizeof(QueueSet));
+    if (!set) return NULL;
+    set->count = count;
+    set->queues = malloc(sizeof(Queue) * count);
+    set->weights = malloc(sizeof(int) * count);
+    set->words = calloc(wordCount, sizeof(unsigned long));
+    if (!set->queues || !set->weights || !set->words
+            || posix_memalign(&set->sectors, QUEUE_SET_LINE,
+                sectorSize * sectorsPerQueue * count)) {
+        destroyQueueSet(set);
+        errno = ENOMEM;
+        return NULL;
+    }
+    register char * sector = set->sectors;
+    for (int i = 0; i < count; ++i) {
+        set->queues[i] = mkQueue();
+        set->weights[i] = 1;
+        for (int s = 0; s < sectorsPerQueue; ++s, sector += sectorSize)
+            submitSector(&set->queues[i], sector, sectorSize);
+    }
+    return set;
+}
+
+int queueSetWeight(QueueSet * const set, int const index, int const weight) {
+    if (!set || index < 0 || index >= set->count || weight <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    set->weights[index] = weight;
+    return 0;
+}
+
+int queueSetWrite(QueueSet * const set, int const index, void * const item) {
+    if (!set || index < 0 || index >= set->count) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (writeItem(&set->queues[index], item)) return -1;
+    markBusy(set, index);
+    return 0;
+}
+
+int queueSetWriteItems(QueueSet * const set, int const index,
+        void * const * const items, int const count) {
+    if (!set || index < 0 || index >= set->count) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int const written = writeItems(&set->queues[index], items, count);
+    if (written > 0) markBusy(set, index);
+    return written;
+}
+
+int selectRead(QueueSet * const set, void ** const items, int * const sources,
+        int const count) {
+    if (!set || !items || count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int got = 0;
+    register int const start = set->next;
+    /* From "next" to the end, then from the start up to "next". */
+    for (int pass = 0; pass < 2 && got < count; ++pass) {
+        register int const end = pass ? start : set->count;
+        register int index = pass ? 0 : start;
+        while (got < count && index < end) {
+            index = nextBusy(set, index);
+            if (index < 0 || index >= end) break;
+            register int want = set->weights[index];
+            if (want > count - got) want = count - got;
+            register int taken = readItems(&set->queues[index], items + got, want);
+            if (taken < 0) taken = 0;
+            if (taken < want) {
+                markIdle(set, index);
+                /* An item written while the bit was still set. */
+                if (readItems(&set->queues[index], items + got + taken, 1) == 1) {
+                    ++taken;
+                    markBusy(set, index);
+                }
+            }
+            if (sources)
+                for (int i = 0; i < taken; ++i) sources[got + i] = index;
+            got += taken;
+            ++index;
+            set->next = index < set->count ? index : 0;
+        }
+    }
+    return got;
+}
+
+void destroyQueueSet(QueueSet * const set) {
+    if (!set) return;
+    free(set->sectors);
+    free((void *)set->words);
+    free(set->weights);
+    free(set->queues);
+    free(set);
+}
@@ -0,0 +1,103 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUEUE_SET_H
+#define QUEUE_SET_H
+
+#include "TransThread.h"
+
+/** The number of bits in a word of the bitmaps. */
+#define QUEUE_SET_BITS (8 * (int)sizeof(unsigned long))
+
+/** The most queues a set can have, one summary word over the bitmap words. */
+#define QUEUE_SET_MAX (QUEUE_SET_BITS * QUEUE_SET_BITS)
+
+/**
+ * Many queues, each with its own write thread, and one read thread.
+ *
+ * Every queue has a bit in a bitmap and every word of the bitmap has a bit in
+ * a summary word. A write thread sets the bit of its queue when it finds it
+ * clear, the read thread clears it when it drains the queue. The read thread
+ * finds the queues with data by scanning the set bits, so the cost of a scan
+ * follows the number of busy queues, not the number of queues.
+ *
+ * The bits are shared by all the threads, so they are changed with atomic
+ * operations. After clearing a bit the read thread looks into the queue once
+ * more, a write thread that wrote just then may have seen the bit still set.
+ * For the same reason the write thread has a full barrier between publishing
+ * the item and looking at the bit.
+ */
+typedef struct QueueSet QueueSet;
+
+/**
+ * Creates a set of queues, each one with its own sectors.
+ * @param count the number of queues, up to QUEUE_SET_MAX.
+ * @param sectorsPerQueue the number of sectors of every queue, at least 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @return the set, NULL on failure.
+ */
+QueueSet * createQueueSet(int const count, int const sectorsPerQueue,
+        int const itemsPerSector);
+
+/**
+ * Sets how many items a queue gives, at most, every time the read thread
+ * visits it. The default is 1.
+ * Must be called before the threads use the set.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int queueSetWeight(QueueSet * const set, int const index, int const weight);
+
+/**
+ * Writes an item into a queue of the set, from the write thread of that queue.
+ * @return On success 0, -1 otherwise (ENOMEM if the queue is full).
+ */
+int queueSetWrite(QueueSet * const set, int const index, void * const item);
+
+/**
+ * Writes a batch of items into a queue of the set, from the write thread of
+ * that queue.
+ * @return the number of items written, less then count if the queue got full
+ * (ENOMEM), -1 on invalid arguments.
+ */
+int queueSetWriteItems(QueueSet * const set, int const index,
+        void * const * const items, int const count);
+
+/**
+ * Reads up to count items from the busy queues, from the read thread.
+ * The busy queues are visited in round robin, starting after the queue
+ * visited last, and each gives at most its weight in items.
+ * Every busy queue is visited at most once per call.
+ * @param set the set.
+ * @param items the array that receives the items.
+ * @param sources the array that receives the index of the queue of every
+ * item, it can be NULL.
+ * @param count the size of the arrays.
+ * @return the number of items read, -1 on invalid arguments.
+ */
+int selectRead(QueueSet * const set, void ** const items, int * const sources,
+        int const count);
+
+/**
+ * Releases the set and the sectors.
+ * Must be called when no thread uses the set.
+ */
+void destroyQueueSet(QueueSet * const set);
+
+#endif
@@ -0,0 +1,247 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+
+#include "Router.h"
+
+#define ROUTER_LINE 64
+/** A hot key is not judged before the router saw that many items. */
+#define ROUTER_HOT_MIN 64
+
+/** A key watched for the hot key split. */
+typedef struct HotKey {
+    uint64_t key;
+    unsigned long count;
+    /**
+     * The count inherited from the key it replaced, the most of "count" that
+     * may belong to other keys: the key itself had at least count - error.
+     */
+    unsigned long error;
+    /** The partition, after the one of the key, of its next item. */
+    int next;
+} HotKey;
+
+struct Router {
+    int partitions;
+    int batch;
+    RouterKey key;
+    void * context;
+    Queue * queues;
+    void * sectors;
+    /** The batch of every partition, one after the other. */
+    void ** pending;
+    int * held;
+    PartitionStats * stats;
+    double hotShare;
+    int hotWays;
+    int hotCount;
+    unsigned long hotTotal;
+    HotKey hot[ROUTER_HOT_KEYS];
+};
+
+Router * createRouter(int const partitions, int const sectorsPerQueue,
+        int const itemsPerSector, int const batch, RouterKey const key,
+        void * const context) {
+    if (partitions <= 0 || sectorsPerQueue < 2 || itemsPerSector <= 0 || batch <= 0
+            || !key) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector)
+            + ROUTER_LINE - 1) / ROUTER_LINE * ROUTER_LINE;
+    Router * const router = calloc(1, sizeof(Router));
+    if (!router) return NULL;
+    router->partitions = partitions;
+    router->batch = batch;
+    router->key = key;
+    router->context = context;
+    router->queues = malloc(sizeof(Queue) * partitions);
+    router->pending = malloc(sizeof(void *) * batch * partitions);
+    router->held = calloc(partitions, sizeof(int));
+    router->stats = calloc(partitions, sizeof(PartitionStats));
+    if (!router->queues || !router->pending || !router->held || !router->stats
+            || posix_memalign(&router->sectors, ROUTER_LINE,
+                sectorSize * sectorsPerQueue * partitions)) {
+        destroyRouter(router);
+        errno = ENOMEM;
+        return NULL;
+    }
+    register char * sector = router->sectors;
+    for (int p = 0; p < partitions; ++p) {
+        router->queues[p] = mkQueue();
+        for (int s = 0; s < sectorsPerQueue; ++s, sector += sectorSize)
+            submitSector(&router->queues[p], sector, sectorSize);
+    }
+    return router;
+}
+
+int routerHotSplit(Router * const router, double const share, int const ways) {
+    if (!router || share <= 0 || share >= 1 || ways < 1 || ways > router->partitions) {
+        errno = EINVAL;
+        return -1;
+    }
+    router->hotShare = share;
+    router->hotWays = ways;
+    return 0;
+}
+
+/** @return the partition of a key, from the high bits of its mixed hash. */
+static inline int partitionOf(Router const * const router, uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return (int)(((key >> 32) * (uint64_t)router->partitions) >> 32);
+}
+
+/**
+ * Counts a key in the table of the busiest keys.
+ * @return the entry of the key if it is hot, NULL otherwise.
+ */
+static HotKey * countHot(Router * const router, uint64_t const key) {
+    register HotKey * entry = NULL;
+    register HotKey * least = NULL;
+    for (int i = 0; i < router->hotCount; ++i) {
+        if (router->hot[i].key == key) {
+            entry = &router->hot[i];
+            break;
+        }
+        if (!least || router->hot[i].count < least->count) least = &router->hot[i];
+    }
+    if (!entry) {
+        if (router->hotCount < ROUTER_HOT_KEYS) entry = &router->hot[router->hotCount++];
+        else entry = least;
+        /* The newcomer inherits the count of the one it replaced, as error. */
+        if (entry != least) entry->count = 0;
+        entry->error = entry->count;
+        entry->key = key;
+        entry->next = 0;
+    }
+    ++entry->count;
+    if (++router->hotTotal == ROUTER_HOT_WINDOW) {
+        router->hotTotal /= 2;
+        for (int i = 0; i < router->hotCount; ++i) {
+            router->hot[i].count /= 2;
+            router->hot[i].error /= 2;
+        }
+    }
+    /* Only the items surely of this key count, so a newcomer is not hot. */
+    if (router->hotTotal < ROUTER_HOT_MIN
+            || entry->count - entry->error <= router->hotShare * router->hotTotal) return NULL;
+    return entry;
+}
+
+/** Writes the batch of a partition, as much as its queue takes. */
+static void flushPartition(Router * const router, int const partition) {
+    register int const held = router->held[partition];
+    if (!held) return;
+    register void ** const pending = router->pending + partition * router->batch;
+    register int const written = writeItems(&router->queues[partition], pending, held);
+    if (written <= 0) {
+        ++router->stats[partition].full;
+        return;
+    }
+    ++router->stats[partition].batches;
+    if (written < held) ++router->stats[partition].full;
+    for (int i = written; i < held; ++i) pending[i - written] = pending[i];
+    router->held[partition] = held - written;
+}
+
+int routerWrite(Router * const router, void * const item) {
+    if (!router) {
+        errno = EINVAL;
+        return -1;
+    }
+    register uint64_t const key = router->key(item, router->context);
+    register int partition = partitionOf(router, key);
+    register int hot = 0;
+    if (router->hotWays > 1) {
+        register HotKey * const entry = countHot(router, key);
+        if (entry) {
+            partition = (partition + entry->next) % router->partitions;
+            if (++entry->next == router->hotWays) entry->next = 0;
+            hot = 1;
+        }
+    }
+    if (router->held[partition] == router->batch) {
+        flushPartition(router, partition);
+        if (router->held[partition] == router->batch) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    router->pending[partition * router->batch + router->held[partition]++] = item;
+    ++router->stats[partition].items;
+    router->stats[partition].hotItems += hot;
+    if (router->held[partition] == router->batch) flushPartition(router, partition);
+    return 0;
+}
+
+int routerFlush(Router * const router) {
+    if (!router) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int held = 0;
+    for (int p = 0; p < router->partitions; ++p) {
+        flushPartition(router, p);
+        held += router->held[p];
+    }
+    return held;
+}
+
+Queue * routerQueue(Router * const router, int const partition) {
+    if (!router || partition < 0 || partition >= router->partitions) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return &router->queues[partition];
+}
+
+int routerStats(Router const * const router, int const partition,
+        PartitionStats * const stats) {
+    if (!router || partition < 0 || partition >= router->partitions || !stats) {
+        errno = EINVAL;
+        return -1;
+    }
+    *stats = router->stats[partition];
+    return 0;
+}
+
+double routerSkew(Router const * const router) {
+    if (!router) return 0;
+    register unsigned long total = 0, most = 0;
+    for (int p = 0; p < router->partitions; ++p) {
+        total += router->stats[p].items;
+        if (router->stats[p].items > most) most = router->stats[p].items;
+    }
+    return total ? (double)most * router->partitions / total : 0;
+}
+
+void destroyRouter(Router * const router) {
+    if (!router) return;
+    free(router->sectors);
+    free(router->stats);
+    free(router->held);
+    free(router->pending);
+    free(router->queues);
+    free(router);
+}
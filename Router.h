@@ -0,0 +1,131 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdint.h>
+
+#include "TransThread.h"
+
+/** The number of keys the router watches for the hot key split. */
+#define ROUTER_HOT_KEYS 16
+
+/** The items after which the counts of the watched keys are halved. */
+#define ROUTER_HOT_WINDOW 4096
+
+/**
+ * Gives the key of an item.
+ * @param item the item.
+ * @param context the context given to 'createRouter'.
+ */
+typedef uint64_t (*RouterKey)(void const * item, void * context);
+
+/** The counters of a partition, all of them since the creation. */
+typedef struct PartitionStats {
+    /** The items routed to the partition. */
+    unsigned long items;
+    /** The batches written into its queue. */
+    unsigned long batches;
+    /** The times its queue was full. */
+    unsigned long full;
+    /** The items of a hot key sent here by the split. */
+    unsigned long hotItems;
+} PartitionStats;
+
+/**
+ * Sends every item to one of many queues, the partitions, chosen by the hash
+ * of its key, so the items of a key always go to the same worker, the read
+ * thread of that queue, and the worker can keep the state of its keys alone.
+ *
+ * The router is the write thread of all the partitions. It keeps a batch for
+ * every partition and writes it with one 'writeItems' when it is full or on
+ * 'routerFlush'.
+ *
+ * A key can be too busy for one worker. With the hot key split the router
+ * counts the busiest keys over the last items, in a small table where a new
+ * key takes the place of the least counted one, and the items of a key with
+ * more then a given share of them are spread over a few partitions, the one
+ * of the key and the ones after it. Those items lose the one worker guarantee,
+ * so the split is off unless asked for.
+ */
+typedef struct Router Router;
+
+/**
+ * Creates a router.
+ * @param partitions the number of partitions.
+ * @param sectorsPerQueue the number of sectors of every queue, at least 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @param batch the most items kept for a partition before writing them.
+ * @param key gives the key of an item.
+ * @param context the last argument of key.
+ * @return the router, NULL on failure.
+ */
+Router * createRouter(int const partitions, int const sectorsPerQueue,
+        int const itemsPerSector, int const batch, RouterKey const key,
+        void * const context);
+
+/**
+ * Turns on the hot key split, before the router is used.
+ * @param share a key with more then this share of the recent items is hot,
+ * between 0 and 1. Only the ROUTER_HOT_KEYS busiest keys are watched, a key
+ * below 1 / ROUTER_HOT_KEYS of the items may be missed but a key is never hot
+ * by the items of others.
+ * @param ways the number of partitions the items of a hot key are spread on.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int routerHotSplit(Router * const router, double const share, int const ways);
+
+/**
+ * Routes an item.
+ * @return On success 0, -1 otherwise (ENOMEM if the batch of its partition is
+ * full and its queue too).
+ */
+int routerWrite(Router * const router, void * const item);
+
+/**
+ * Writes the batches of all the partitions.
+ * @return the number of items still kept, because their queues are full.
+ */
+int routerFlush(Router * const router);
+
+/** @return the queue of a partition, for its worker to read, NULL if none. */
+Queue * routerQueue(Router * const router, int const partition);
+
+/**
+ * Takes a snapshot of the counters of a partition, from the router thread.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int routerStats(Router const * const router, int const partition,
+        PartitionStats * const stats);
+
+/**
+ * @return the items of the busiest partition over the mean, 1 when the items
+ * are spread evenly, 0 before any item.
+ */
+double routerSkew(Router const * const router);
+
+/**
+ * Releases the router, the items kept are dropped.
+ * Must be called when no thread uses it.
+ */
+void destroyRouter(Router * const router);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+
+#include "RpcChannel.h"
+
+#define RPC_CHANNEL_LINE 64
+/** The completions taken from the response queue at once. */
+#define RPC_POLL_BATCH 64
+
+/** A slot, alone on its cache lines. */
+typedef struct RpcSlot {
+    RpcCall call;
+} __attribute__((aligned(RPC_CHANNEL_LINE))) RpcSlot;
+
+struct RpcChannel {
+    Queue requests;
+    Queue responses;
+    int slotCount;
+    RpcSlot * slots;
+    void * sectors;
+    /** Handled only by the client thread. */
+    RpcCall ** free __attribute__((aligned(RPC_CHANNEL_LINE)));
+    int freeCount;
+    uint64_t lastId;
+};
+
+RpcChannel * createRpcChannel(int const slots, int const itemsPerSector) {
+    if (slots <= 0 || itemsPerSector <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector)
+            + RPC_CHANNEL_LINE - 1) / RPC_CHANNEL_LINE * RPC_CHANNEL_LINE;
+    /* Enough for all the slots plus a sector half read and one half written. */
+    register int const sectors = (slots + itemsPerSector - 1) / itemsPerSector + 2;
+    RpcChannel * channel;
+    if (posix_memalign((void **)&channel, RPC_CHANNEL_LINE, sizeof(RpcChannel))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    channel->slotCount = slots;
+    channel->slots = NULL;
+    channel->sectors = NULL;
+    channel->free = malloc(sizeof(RpcCall *) * slots);
+    if (!channel->free
+            || posix_memalign((void **)&channel->slots, RPC_CHANNEL_LINE, sizeof(RpcSlot) * slots)
+            || posix_memalign(&channel->sectors, RPC_CHANNEL_LINE, sectorSize * sectors * 2)) {
+        destroyRpcChannel(channel);
+        errno = ENOMEM;
+        return NULL;
+    }
+    channel->requests = mkQueue();
+    channel->responses = mkQueue();
+    for (int s = 0; s < sectors; ++s) {
+        submitSector(&channel->requests, (char *)channel->sectors + sectorSize * s, sectorSize);
+        submitSector(&channel->responses,
+                (char *)channel->sectors + sectorSize * (sectors + s), sectorSize);
+    }
+    for (int i = 0; i < slots; ++i) channel->free[i] = &channel->slots[slots - 1 - i].call;
+    channel->freeCount = slots;
+    channel->lastId = 0;
+    return channel;
+}
+
+uint64_t rpcCall(RpcChannel * const channel, void * const request, void * const context) {
+    if (!channel) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (!channel->freeCount) {
+        errno = EAGAIN;
+        return 0;
+    }
+    register RpcCall * const call = channel->free[--channel->freeCount];
+    call->id = ++channel->lastId;
+    call->request = request;
+    call->response = NULL;
+    call->status = 0;
+    call->context = context;
+    if (writeItem(&channel->requests, call)) {
+        /* The slot never left, it is free again and so is its id. */
+        channel->free[channel->freeCount++] = call;
+        --channel->lastId;
+        return 0;
+    }
+    return call->id;
+}
+
+int rpcReceive(RpcChannel * const channel, RpcCall ** const calls, int const count) {
+    if (!channel || !calls || count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return readItems(&channel->requests, (void **)calls, count);
+}
+
+int rpcReply(RpcChannel * const channel, RpcCall * const call) {
+    if (!channel || !call) {
+        errno = EINVAL;
+        return -1;
+    }
+    return writeItem(&channel->responses, call);
+}
+
+int rpcPoll(RpcChannel * const channel, RpcCall * const completed, int const count) {
+    if (!channel || !completed || count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    RpcCall * calls[RPC_POLL_BATCH];
+    register int got = 0;
+    while (got < count) {
+        register int const want = count - got < RPC_POLL_BATCH ? count - got : RPC_POLL_BATCH;
+        register int const taken = readItems(&channel->responses, (void **)calls, want);
+        if (taken <= 0) break;
+        for (int i = 0; i < taken; ++i) {
+            completed[got + i] = *calls[i];
+            channel->free[channel->freeCount++] = calls[i];
+        }
+        got += taken;
+        if (taken < want) break;
+    }
+    return got;
+}
+
+void destroyRpcChannel(RpcChannel * const channel) {
+    if (!channel) return;
+    free(channel->sectors);
+    free(channel->slots);
+    free(channel->free);
+    free(channel);
+}
@@ -0,0 +1,99 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RPC_CHANNEL_H
+#define RPC_CHANNEL_H
+
+#include <stdint.h>
+
+#include "TransThread.h"
+
+/** A call, from the request to the response, kept in a slot of the channel. */
+typedef struct RpcCall {
+    /** Given by 'rpcCall', never 0. */
+    uint64_t id;
+    void * request;
+    /** Filled by the server thread before 'rpcReply'. */
+    void * response;
+    /** Filled by the server thread before 'rpcReply'. */
+    int status;
+    /** Whatever the client thread passed to 'rpcCall'. */
+    void * context;
+} RpcCall;
+
+/**
+ * Calls from a client thread to a server thread and back, over two queues.
+ *
+ * The calls live in slots allocated at creation, so a call allocates nothing.
+ * The client takes a free slot, fills it and writes it into the request
+ * queue; the server reads it, fills the response into the same slot and
+ * writes it into the response queue; the client polls the completed slots in
+ * batches, copies them out and frees them. The id of a call ties it to its
+ * completion.
+ *
+ * The two queues share one block of sectors, each holds all the slots so they
+ * never get full.
+ */
+typedef struct RpcChannel RpcChannel;
+
+/**
+ * Creates a channel.
+ * @param slots the most calls in flight.
+ * @param itemsPerSector the number of items in every sector of the two queues.
+ * @return the channel, NULL on failure.
+ */
+RpcChannel * createRpcChannel(int const slots, int const itemsPerSector);
+
+/**
+ * Starts a call, from the client thread.
+ * @return the id of the call, 0 on failure: EAGAIN if all the slots are in
+ * flight, ENOMEM if the request queue is full, then the slot is free again.
+ */
+uint64_t rpcCall(RpcChannel * const channel, void * const request, void * const context);
+
+/**
+ * Takes up to count requests, from the server thread.
+ * @param calls receives the calls, to be answered with 'rpcReply'.
+ * @return the number of calls, -1 on invalid arguments (EINVAL).
+ */
+int rpcReceive(RpcChannel * const channel, RpcCall ** const calls, int const count);
+
+/**
+ * Sends back a call received with 'rpcReceive', from the server thread,
+ * after filling its response and status.
+ * @return On success 0, -1 otherwise (ENOMEM if the response queue is full,
+ * the call can be replied again later).
+ */
+int rpcReply(RpcChannel * const channel, RpcCall * const call);
+
+/**
+ * Takes up to count completed calls, from the client thread.
+ * The calls are copied out and their slots are free again.
+ * @return the number of completed calls, -1 on invalid arguments (EINVAL).
+ */
+int rpcPoll(RpcChannel * const channel, RpcCall * const completed, int const count);
+
+/**
+ * Releases the channel.
+ * Must be called when no thread uses the channel.
+ */
+void destroyRpcChannel(RpcChannel * const channel);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "SectorPool.h"
+
+#define SECTOR_POOL_LINE 64
+#define INDEX_MASK 0xffffffffull
+
+struct SectorPool {
+    char * memory;
+    size_t sectorSize;
+    long int sectors;
+    /** The next sector on the stack, 1 based, for every sector. */
+    uint32_t volatile * next;
+    /** The top of the stack, 1 based, 0 if empty, and the tag above it. */
+    uint64_t volatile head __attribute__((aligned(SECTOR_POOL_LINE)));
+    long int volatile available;
+};
+
+struct SectorCache {
+    SectorPool * pool;
+    int capacity;
+    int count;
+    uint32_t indexes[];
+};
+
+SectorPool * createSectorPool(long int const sectors, int const itemsPerSector) {
+    if (sectors <= 0 || (uint64_t)sectors >= INDEX_MASK || itemsPerSector <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    SectorPool * pool;
+    if (posix_memalign((void **)&pool, SECTOR_POOL_LINE, sizeof(SectorPool))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector) + SECTOR_POOL_LINE - 1)
+        / SECTOR_POOL_LINE * SECTOR_POOL_LINE;
+    pool->sectors = sectors;
+    pool->next = malloc(sizeof(uint32_t) * sectors);
+    if (!pool->next || posix_memalign((void **)&pool->memory, SECTOR_POOL_LINE,
+                pool->sectorSize * sectors)) {
+        free((void *)pool->next);
+        free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (long int i = 0; i < sectors; ++i) pool->next[i] = i + 1 < sectors ? i + 2 : 0;
+    pool->head = 1;
+    pool->available = sectors;
+    return pool;
+}
+
+size_t sectorPoolSectorSize(SectorPool const * const pool) {
+    return pool->sectorSize;
+}
+
+long int sectorPoolAvailable(SectorPool const * const pool) {
+    return pool->available;
+}
+
+/** Pushes a chain of sectors, from first to last, already linked. */
+static void pushChain(SectorPool * const pool, uint32_t const first, uint32_t const last,
+        int const count) {
+    register uint64_t old, tmp;
+    do {
+        old = pool->head;
+        pool->next[last - 1] = old & INDEX_MASK;
+        tmp = ((old >> 32) + 1) << 32 | first;
+    } while (!__sync_bool_compare_and_swap(&pool->head, old, tmp));
+    __sync_fetch_and_add(&pool->available, count);
+}
+
+/** @return the sector on the top of the stack, 1 based, 0 if empty. */
+static uint32_t pop(SectorPool * const pool) {
+    register uint64_t old, tmp;
+    register uint32_t top;
+    do {
+        old = pool->head;
+        top = old & INDEX_MASK;
+        if (!top) return 0;
+        /* If the sector was taken meanwhile the tag changed and we try again. */
+        tmp = ((old >> 32) + 1) << 32 | pool->next[top - 1];
+    } while (!__sync_bool_compare_and_swap(&pool->head, old, tmp));
+    __sync_fetch_and_sub(&pool->available, 1);
+    return top;
+}
+
+SectorCache * createSectorCache(SectorPool * const pool, int const capacity) {
+    if (!pool || capacity < 2) {
+        errno = EINVAL;
+        return NULL;
+    }
+    SectorCache * const cache = malloc(sizeof(SectorCache) + sizeof(uint32_t) * capacity);
+    if (!cache) return NULL;
+    cache->pool = pool;
+    cache->capacity = capacity;
+    cache->count = 0;
+    return cache;
+}
+
+/** Gives the oldest "count" sectors of the cache back to the stack. */
+static void flush(SectorCache * const cache, int const count) {
+    if (!count) return;
+    register SectorPool * const pool = cache->pool;
+    for (int i = 0; i + 1 < count; ++i) pool->next[cache->indexes[i] - 1] = cache->indexes[i + 1];
+    pushChain(pool, cache->indexes[0], cache->indexes[count - 1], count);
+    cache->count -= count;
+    for (int i = 0; i < cache->count; ++i) cache->indexes[i] = cache->indexes[count + i];
+}
+
+void * sectorPoolAlloc(SectorCache * const cache) {
+    register SectorPool * const pool = cache->pool;
+    if (!cache->count) {
+        for (int i = 0; i < cache->capacity / 2; ++i) {
+            register uint32_t const index = pop(pool);
+            if (!index) break;
+            cache->indexes[cache->count++] = index;
+        }
+        if (!cache->count) {
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    return pool->memory + pool->sectorSize * (cache->indexes[--cache->count] - 1);
+}
+
+void sectorPoolFree(SectorCache * const cache, void * const sector) {
+    if (cache->count == cache->capacity) flush(cache, cache->capacity / 2);
+    cache->indexes[cache->count++] =
+        ((char *)sector - cache->pool->memory) / cache->pool->sectorSize + 1;
+}
+
+/** Gives the queue one more sector. */
+static int grow(SectorCache * const cache, Queue * const queue) {
+    register void * const sector = sectorPoolAlloc(cache);
+    if (!sector) return -1;
+    return submitSector(queue, sector, cache->pool->sectorSize);
+}
+
+int sectorPoolWriteItem(SectorCache * const cache, Queue * const queue, void * const item) {
+    if (!writeItem(queue, item)) return 0;
+    if (errno != ENOMEM || grow(cache, queue)) return -1;
+    return writeItem(queue, item);
+}
+
+int sectorPoolWriteItems(SectorCache * const cache, Queue * const queue,
+        void * const * const items, int const count) {
+    register int done = writeItems(queue, items, count);
+    while (done >= 0 && done < count && errno == ENOMEM && !grow(cache, queue))
+        done += writeItems(queue, items + done, count - done);
+    return done;
+}
+
+int sectorPoolTrim(SectorCache * const cache, Queue * const queue, int const keep) {
+    register int given = 0;
+    for (register int spare = countSpareSectors(queue); spare > keep; --spare) {
+        register void * const sector = recoverSector(queue);
+        if (!sector) break;
+        sectorPoolFree(cache, sector);
+        ++given;
+    }
+    return given;
+}
+
+int sectorPoolReleaseQueue(SectorCache * const cache, Queue * const queue) {
+    errno = 0;
+    register struct QueueSector * sector = releaseSectors(queue);
+    if (!sector && errno) return -1;
+    register int given = 0;
+    while (sector) {
+        register struct QueueSector * const next = nextReleasedSector(sector);
+        sectorPoolFree(cache, sector);
+        sector = next;
+        ++given;
+    }
+    return given;
+}
+
+void destroySectorCache(SectorCache * const cache) {
+    if (!cache) return;
+    flush(cache, cache->count);
+    free(cache);
+}
+
+void destroySectorPool(SectorPool * const pool) {
+    if (!pool) return;
+    free(pool->memory);
+    free((void *)pool->next);
+    free(pool);
+}
@@ -0,0 +1,115 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SECTOR_POOL_H
+#define SECTOR_POOL_H
+
+#include "TransThread.h"
+
+/**
+ * Sectors shared by many queues, so the memory follows the sum of the
+ * backlogs, not the sum of the peaks.
+ *
+ * The sectors, all of one size, are cut from one block and known by their
+ * index. The free ones are on a lock free stack: its head is the index of the
+ * top sector with a tag that changes with every push and pop, swapped with
+ * one compare and swap, so a sector popped and pushed back meanwhile does not
+ * fool it.
+ *
+ * Every thread goes through a cache of its own, a few free sectors it takes
+ * and gives without any atomic operation; the cache refills from the stack
+ * and gives its surplus back, half of it at a time.
+ */
+typedef struct SectorPool SectorPool;
+
+/** The free sectors of one thread, in front of a SectorPool. */
+typedef struct SectorCache SectorCache;
+
+/**
+ * Creates a pool.
+ * @param sectors the number of sectors, up to 2^32 - 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @return the pool, NULL on failure.
+ */
+SectorPool * createSectorPool(long int const sectors, int const itemsPerSector);
+
+/** @return the size of the sectors of the pool, for 'submitSector'. */
+size_t sectorPoolSectorSize(SectorPool const * const pool);
+
+/** @return the sectors on the shared stack, not counting the caches. */
+long int sectorPoolAvailable(SectorPool const * const pool);
+
+/**
+ * Creates a cache for the calling thread.
+ * @param capacity the most sectors it keeps, at least 2.
+ * @return the cache, NULL on failure.
+ */
+SectorCache * createSectorCache(SectorPool * const pool, int const capacity);
+
+/**
+ * Takes a sector.
+ * @return the memory of the sector, NULL if the pool is empty (ENOMEM).
+ */
+void * sectorPoolAlloc(SectorCache * const cache);
+
+/** Gives back a sector taken with 'sectorPoolAlloc'. */
+void sectorPoolFree(SectorCache * const cache, void * const sector);
+
+/**
+ * Writes an item as 'writeItem', from the write thread of the queue. When
+ * the queue is full it submits a sector of the pool and tries again.
+ * @return On success 0, -1 otherwise (ENOMEM if the pool is empty too).
+ */
+int sectorPoolWriteItem(SectorCache * const cache, Queue * const queue, void * const item);
+
+/**
+ * Writes items as 'writeItems', taking sectors from the pool as needed.
+ * @return the number of items written, -1 on invalid arguments.
+ */
+int sectorPoolWriteItems(SectorCache * const cache, Queue * const queue,
+        void * const * const items, int const count);
+
+/**
+ * Gives the spare sectors of a queue back to the pool, keeping some, from the
+ * write thread of the queue. All the sectors of the queue must come from the
+ * pool.
+ * @param keep the spare sectors left to the queue.
+ * @return the number of sectors given back.
+ */
+int sectorPoolTrim(SectorCache * const cache, Queue * const queue, int const keep);
+
+/**
+ * Gives all the sectors of a closed queue back to the pool, with
+ * 'releaseSectors'.
+ * @return the number of sectors given back, -1 on failure (EAGAIN if the read
+ * thread did not acknowledge the close yet).
+ */
+int sectorPoolReleaseQueue(SectorCache * const cache, Queue * const queue);
+
+/** Gives the sectors of the cache back to the pool and releases the cache. */
+void destroySectorCache(SectorCache * const cache);
+
+/**
+ * Releases the pool and all the sectors.
+ * Must be called when no queue uses its sectors.
+ */
+void destroySectorPool(SectorPool * const pool);
+
+#endif
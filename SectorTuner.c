@@ -0,0 +1,225 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+
+#include "SectorTuner.h"
+
+/** How many sectors 'retire' takes out at most, looking for one to free. */
+#define TUNER_SEARCH 16
+
+/** A sector given to the queue, the tuner has to know its size. */
+typedef struct TunedSector {
+    void * memory;
+    int items;
+} TunedSector;
+
+struct SectorTuner {
+    Queue * queue;
+    TunerConfig config;
+    TunerStats stats;
+    TunedSector * sectors;
+    int capacity;
+    /** The "write" sector after the last write, to spot the recycles. */
+    struct QueueSector * lastWrite;
+    unsigned long windowWrites;
+    unsigned long windowEnomem;
+    unsigned long windowRecycles;
+    int windowPeak;
+    int quietWindows;
+};
+
+static int biggestItems(SectorTuner const * const tuner) {
+    register int biggest = 0;
+    for (int i = 0; i < tuner->stats.sectors; ++i)
+        if (tuner->sectors[i].items > biggest) biggest = tuner->sectors[i].items;
+    return biggest;
+}
+
+static int addSector(SectorTuner * const tuner, int const items) {
+    register size_t const size = QUEUE_SECTOR_SIZE(items);
+    if (tuner->stats.bytes + size > tuner->config.maxBytes) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (tuner->stats.sectors == tuner->capacity) {
+        register int const capacity = tuner->capacity ? tuner->capacity * 2 : 8;
+        TunedSector * const sectors = realloc(tuner->sectors, sizeof(TunedSector) * capacity);
+        if (!sectors) return -1;
+        tuner->sectors = sectors;
+        tuner->capacity = capacity;
+    }
+    void * const memory = malloc(size);
+    if (!memory) return -1;
+    if (submitSector(tuner->queue, memory, size)) {
+        free(memory);
+        return -1;
+    }
+    tuner->sectors[tuner->stats.sectors].memory = memory;
+    tuner->sectors[tuner->stats.sectors].items = items;
+    ++tuner->stats.sectors;
+    tuner->stats.bytes += size;
+    return 0;
+}
+
+/** Forgets a sector taken out of the queue and frees it. */
+static void dropSector(SectorTuner * const tuner, void * const memory) {
+    for (int i = 0; i < tuner->stats.sectors; ++i) {
+        if (tuner->sectors[i].memory != memory) continue;
+        tuner->stats.bytes -= QUEUE_SECTOR_SIZE(tuner->sectors[i].items);
+        tuner->sectors[i] = tuner->sectors[--tuner->stats.sectors];
+        break;
+    }
+    free(memory);
+}
+
+static int itemsOf(SectorTuner const * const tuner, void const * const memory) {
+    for (int i = 0; i < tuner->stats.sectors; ++i)
+        if (tuner->sectors[i].memory == memory) return tuner->sectors[i].items;
+    return 0;
+}
+
+/** Adds a sector twice as big as the biggest one. */
+static int grow(SectorTuner * const tuner) {
+    register int items = biggestItems(tuner) * 2;
+    if (items < tuner->config.minItems) items = tuner->config.minItems;
+    if (items > tuner->config.maxItems) items = tuner->config.maxItems;
+    if (addSector(tuner, items)) return -1;
+    ++tuner->stats.grown;
+    return 0;
+}
+
+static void sample(SectorTuner * const tuner) {
+    register int const live = tuner->stats.sectors - countSpareSectors(tuner->queue);
+    if (live > tuner->windowPeak) tuner->windowPeak = live;
+}
+
+/**
+ * Takes out and frees one sector, or swaps an oversized one for a small one.
+ * The sectors come out from "writeHead" on; the ones that have to stay are
+ * submitted again, last first, so they are back at the head in their order.
+ * When the queue is empty this gets to the "write" sector too.
+ */
+static void retire(SectorTuner * const tuner) {
+    void * kept[TUNER_SEARCH];
+    register int keptCount = 0;
+    while (keptCount < TUNER_SEARCH) {
+        void * const memory = recoverSector(tuner->queue);
+        if (!memory) break;
+        register int const items = itemsOf(tuner, memory);
+        if (tuner->stats.sectors > tuner->config.minSectors
+                || items > tuner->config.minItems) {
+            dropSector(tuner, memory);
+            ++tuner->stats.retired;
+            if (tuner->stats.sectors < tuner->config.minSectors)
+                addSector(tuner, tuner->config.minItems);
+            break;
+        }
+        kept[keptCount++] = memory;
+    }
+    while (keptCount--)
+        submitSector(tuner->queue, kept[keptCount],
+                QUEUE_SECTOR_SIZE(itemsOf(tuner, kept[keptCount])));
+}
+
+SectorTuner * createSectorTuner(Queue * const queue, TunerConfig const * const config) {
+    if (!queue || queue->writeHead || !config || config->minItems <= 0
+            || config->maxItems < config->minItems || config->minSectors < 2
+            || !config->window || config->idleWindows <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    SectorTuner * const tuner = calloc(1, sizeof(SectorTuner));
+    if (!tuner) return NULL;
+    tuner->queue = queue;
+    tuner->config = *config;
+    for (int i = 0; i < config->minSectors; ++i) {
+        if (addSector(tuner, config->minItems)) {
+            destroySectorTuner(tuner);
+            return NULL;
+        }
+    }
+    tuner->lastWrite = queue->write;
+    return tuner;
+}
+
+int tunerWriteItem(SectorTuner * const tuner, void * const item) {
+    if (!tuner) {
+        errno = EINVAL;
+        return -1;
+    }
+    register Queue * const queue = tuner->queue;
+    ++tuner->stats.writes;
+    if (writeItem(queue, item)) {
+        if (errno != ENOMEM) return -1;
+        ++tuner->stats.enomem;
+        ++tuner->windowEnomem;
+        sample(tuner);
+        if (grow(tuner) || writeItem(queue, item)) {
+            ++tuner->stats.failed;
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    if (queue->write != tuner->lastWrite) {
+        tuner->lastWrite = queue->write;
+        ++tuner->stats.recycles;
+        ++tuner->windowRecycles;
+        sample(tuner);
+    }
+    if (++tuner->windowWrites >= tuner->config.window) tunerMaintain(tuner);
+    return 0;
+}
+
+void tunerMaintain(SectorTuner * const tuner) {
+    if (!tuner) return;
+    sample(tuner);
+    register int const spareAtPeak = tuner->stats.sectors - tuner->windowPeak;
+    if (tuner->windowRecycles > tuner->config.recycleLimit) grow(tuner);
+    if (!tuner->windowEnomem && spareAtPeak >= 1) ++tuner->quietWindows;
+    else tuner->quietWindows = 0;
+    if (tuner->quietWindows >= tuner->config.idleWindows
+            && (tuner->stats.sectors > tuner->config.minSectors
+                || biggestItems(tuner) > tuner->config.minItems)) {
+        tuner->quietWindows = 0;
+        retire(tuner);
+    }
+    tuner->stats.peakLiveSectors = tuner->windowPeak;
+    tuner->windowPeak = 0;
+    tuner->windowWrites = tuner->windowEnomem = tuner->windowRecycles = 0;
+    tuner->lastWrite = tuner->queue->write;
+}
+
+void tunerStats(SectorTuner const * const tuner, TunerStats * const stats) {
+    if (!tuner || !stats) return;
+    *stats = tuner->stats;
+}
+
+int destroySectorTuner(SectorTuner * const tuner) {
+    if (!tuner) return 0;
+    for (void * memory; (memory = recoverSector(tuner->queue));)
+        dropSector(tuner, memory);
+    if (tuner->stats.sectors) {
+        errno = EBUSY;
+        return -1;
+    }
+    free(tuner->sectors);
+    free(tuner);
+    return 0;
+}
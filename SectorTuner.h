@@ -0,0 +1,110 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SECTOR_TUNER_H
+#define SECTOR_TUNER_H
+
+#include "TransThread.h"
+
+/** The limits and the thresholds of a sector tuner. */
+typedef struct TunerConfig {
+    /** The number of items of the first sectors and of the smallest ones. */
+    int minItems;
+    /** The number of items of the biggest sector the tuner makes. */
+    int maxItems;
+    /** The number of sectors the tuner keeps at least, at least 2. */
+    int minSectors;
+    /** The most memory the tuner gives to the queue, in bytes. */
+    size_t maxBytes;
+    /** The number of writes between two maintenance runs. */
+    unsigned long window;
+    /** More recycles then this in a window makes the tuner add a bigger sector. */
+    unsigned long recycleLimit;
+    /** The number of quiet windows in a row after which a sector is retired. */
+    int idleWindows;
+} TunerConfig;
+
+/** What the tuner saw, since its creation. */
+typedef struct TunerStats {
+    unsigned long writes;
+    /** The writes that found the queue full. */
+    unsigned long enomem;
+    /** The writes that found the queue full even after the tuner grew it. */
+    unsigned long failed;
+    /** The times a write moved to a recycled sector. */
+    unsigned long recycles;
+    /** The biggest number of sectors holding data seen in the last window. */
+    int peakLiveSectors;
+    /** The number of sectors in the queue. */
+    int sectors;
+    /** The memory of those sectors, in bytes. */
+    size_t bytes;
+    unsigned long grown;
+    unsigned long retired;
+} TunerStats;
+
+/**
+ * A write side manager of the sectors of a queue.
+ *
+ * It owns the sectors of the queue and watches the writes: the ENOMEM
+ * failures, how often a write moves to a recycled sector and how many sectors
+ * hold data.
+ * When a write finds the queue full it adds a sector twice as big as the
+ * biggest one (up to maxItems and maxBytes) and tries again. When sectors are
+ * recycled too often it adds a bigger sector too. When the queue stays quiet,
+ * with spare sectors to spare, it takes the sector at "writeHead" out with
+ * 'recoverSector' and frees it, or swaps it for a small one.
+ *
+ * Everything happens on the write thread, the read thread never waits.
+ */
+typedef struct SectorTuner SectorTuner;
+
+/**
+ * Creates a tuner for an empty queue and gives it minSectors sectors of
+ * minItems items.
+ * @return the tuner, NULL on failure.
+ */
+SectorTuner * createSectorTuner(Queue * const queue, TunerConfig const * const config);
+
+/**
+ * Writes an item, growing the queue if it is full.
+ * @return On success 0, -1 otherwise (ENOMEM if the queue is full and can not
+ * grow any more).
+ */
+int tunerWriteItem(SectorTuner * const tuner, void * const item);
+
+/**
+ * Looks at the last window and grows or shrinks the queue.
+ * 'tunerWriteItem' runs it every "window" writes, call it from the write
+ * thread when the writes stop for a while.
+ */
+void tunerMaintain(SectorTuner * const tuner);
+
+/** Takes a snapshot of the counters, nothing is done if an argument is NULL. */
+void tunerStats(SectorTuner const * const tuner, TunerStats * const stats);
+
+/**
+ * Takes all the sectors out of the queue and frees them and the tuner.
+ * @return On success 0, -1 if some sectors are still in use (EBUSY), then
+ * the tuner is still alive and the call can be repeated.
+ */
+int destroySectorTuner(SectorTuner * const tuner);
+
+#endif
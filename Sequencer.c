@@ -0,0 +1,206 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdlib.h>
+
+#include "Sequencer.h"
+
+#define SEQUENCER_LINE 64
+/** The envelopes taken from an output queue at once. */
+#define SEQUENCER_BATCH 64
+
+/** An envelope, alone on its cache line. */
+typedef struct Envelope {
+    SequencedItem sequenced;
+} __attribute__((aligned(SEQUENCER_LINE))) Envelope;
+
+/** The items a worker finished, written only by that worker. */
+typedef struct WorkerCount {
+    unsigned long volatile done;
+} __attribute__((aligned(SEQUENCER_LINE))) WorkerCount;
+
+struct Sequencer {
+    int workers;
+    int window;
+    int policy;
+    Envelope * envelopes;
+    Queue * inputs;
+    Queue * outputs;
+    WorkerCount * done;
+    void * sectors;
+    /** Handled only by the dispatch thread. */
+    unsigned long next __attribute__((aligned(SEQUENCER_LINE)));
+    int turn;
+    unsigned long * dispatched;
+    /** The items collected, written only by the collect thread. */
+    unsigned long volatile collected __attribute__((aligned(SEQUENCER_LINE)));
+    /** Which envelopes came back, handled only by the collect thread. */
+    char * back;
+    /** The output queue to read first, handled only by the collect thread. */
+    int source;
+};
+
+Sequencer * createSequencer(int const workers, int const window,
+        int const sectorsPerQueue, int const itemsPerSector, int const policy) {
+    if (workers <= 0 || window <= 0 || sectorsPerQueue < 2 || itemsPerSector <= 0
+            || (policy != sequenceRoundRobin && policy != sequenceLeastLoaded)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(itemsPerSector)
+            + SEQUENCER_LINE - 1) / SEQUENCER_LINE * SEQUENCER_LINE;
+    Sequencer * sequencer;
+    if (posix_memalign((void **)&sequencer, SEQUENCER_LINE, sizeof(Sequencer))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    sequencer->workers = workers;
+    sequencer->window = window;
+    sequencer->policy = policy;
+    sequencer->envelopes = NULL;
+    sequencer->done = NULL;
+    sequencer->sectors = NULL;
+    sequencer->inputs = malloc(sizeof(Queue) * workers * 2);
+    sequencer->outputs = sequencer->inputs ? sequencer->inputs + workers : NULL;
+    sequencer->dispatched = calloc(workers, sizeof(unsigned long));
+    sequencer->back = calloc(window, 1);
+    if (!sequencer->inputs || !sequencer->dispatched || !sequencer->back
+            || posix_memalign((void **)&sequencer->envelopes, SEQUENCER_LINE,
+                sizeof(Envelope) * window)
+            || posix_memalign((void **)&sequencer->done, SEQUENCER_LINE,
+                sizeof(WorkerCount) * workers)
+            || posix_memalign(&sequencer->sectors, SEQUENCER_LINE,
+                sectorSize * sectorsPerQueue * workers * 2)) {
+        destroySequencer(sequencer);
+        errno = ENOMEM;
+        return NULL;
+    }
+    register char * sector = sequencer->sectors;
+    for (int q = 0; q < workers * 2; ++q) {
+        sequencer->inputs[q] = mkQueue();
+        for (int s = 0; s < sectorsPerQueue; ++s, sector += sectorSize)
+            submitSector(&sequencer->inputs[q], sector, sectorSize);
+    }
+    for (int w = 0; w < workers; ++w) sequencer->done[w].done = 0;
+    sequencer->next = 0;
+    sequencer->turn = 0;
+    sequencer->collected = 0;
+    sequencer->source = 0;
+    return sequencer;
+}
+
+/** @return the worker to give the next item to. */
+static int pickWorker(Sequencer * const sequencer) {
+    if (sequencer->policy == sequenceRoundRobin) return sequencer->turn;
+    register int best = 0;
+    register unsigned long bestLoad = ~0ul;
+    for (int w = 0; w < sequencer->workers; ++w) {
+        register unsigned long const load =
+            sequencer->dispatched[w] - sequencer->done[w].done;
+        if (load < bestLoad) {
+            best = w;
+            bestLoad = load;
+        }
+    }
+    return best;
+}
+
+int sequencerDispatch(Sequencer * const sequencer, void * const item) {
+    if (!sequencer) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (sequencer->next - sequencer->collected >= (unsigned long)sequencer->window) {
+        errno = ENOMEM;
+        return -1;
+    }
+    register int const worker = pickWorker(sequencer);
+    register SequencedItem * const envelope =
+        &sequencer->envelopes[sequencer->next % sequencer->window].sequenced;
+    envelope->sequence = sequencer->next;
+    envelope->item = item;
+    envelope->result = NULL;
+    if (writeItem(&sequencer->inputs[worker], envelope)) return -1;
+    ++sequencer->next;
+    ++sequencer->dispatched[worker];
+    if (++sequencer->turn == sequencer->workers) sequencer->turn = 0;
+    return 0;
+}
+
+SequencedItem * sequencerTake(Sequencer * const sequencer, int const worker) {
+    if (!sequencer || worker < 0 || worker >= sequencer->workers) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return readItem(&sequencer->inputs[worker]);
+}
+
+int sequencerPut(Sequencer * const sequencer, int const worker,
+        SequencedItem * const envelope) {
+    if (!sequencer || worker < 0 || worker >= sequencer->workers || !envelope) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (writeItem(&sequencer->outputs[worker], envelope)) return -1;
+    ++sequencer->done[worker].done;
+    return 0;
+}
+
+int sequencerCollect(Sequencer * const sequencer, void ** const results, int const count) {
+    if (!sequencer || !results || count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int const window = sequencer->window;
+    void * envelopes[SEQUENCER_BATCH];
+    /* Every output queue once, starting after the one read first last time. */
+    for (int i = 0; i < sequencer->workers; ++i) {
+        register int const w = (sequencer->source + i) % sequencer->workers;
+        register int const got = readItems(&sequencer->outputs[w], envelopes, SEQUENCER_BATCH);
+        for (int e = 0; e < got; ++e)
+            sequencer->back[((SequencedItem *)envelopes[e])->sequence % window] = 1;
+    }
+    if (++sequencer->source == sequencer->workers) sequencer->source = 0;
+    register int given = 0;
+    register unsigned long collected = sequencer->collected;
+    while (given < count && sequencer->back[collected % window]) {
+        sequencer->back[collected % window] = 0;
+        results[given++] = sequencer->envelopes[collected % window].sequenced.result;
+        ++collected;
+    }
+    /*
+     * The envelopes are free again only once their results were taken: the
+     * loads above must be done before the dispatch thread sees the new count
+     * and writes into those envelopes.
+     */
+    __sync_synchronize();
+    sequencer->collected = collected;
+    return given;
+}
+
+void destroySequencer(Sequencer * const sequencer) {
+    if (!sequencer) return;
+    free(sequencer->sectors);
+    free(sequencer->done);
+    free(sequencer->envelopes);
+    free(sequencer->back);
+    free(sequencer->dispatched);
+    free(sequencer->inputs);
+    free(sequencer);
+}
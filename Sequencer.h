@@ -0,0 +1,107 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include "TransThread.h"
+
+/** An item on its way through a worker, in the envelope of its sequence. */
+typedef struct SequencedItem {
+    /** The order of the item, given by 'sequencerDispatch' from 0 on. */
+    unsigned long sequence;
+    void * item;
+    /** Filled by the worker before 'sequencerPut'. */
+    void * result;
+} SequencedItem;
+
+/** How the dispatch thread picks the worker of an item. */
+typedef enum SequencerPolicy {
+    /** Every worker in turn, waiting for the one whose turn it is. */
+    sequenceRoundRobin,
+    /** The worker with the fewest items dispatched and not done yet. */
+    sequenceLeastLoaded
+} SequencerPolicy;
+
+/**
+ * Runs a stage on many worker threads and keeps the order of the items.
+ *
+ * One dispatch thread writes the items into the input queues of the workers,
+ * each worker writes what it did into its own output queue and one collect
+ * thread reads all the output queues and gives the results back in the order
+ * of the items.
+ *
+ * An item travels in an envelope, one of "window" made at creation, the one
+ * of its sequence modulo window. The collect thread marks the envelopes that
+ * came back and gives the results while the envelope of the next sequence is
+ * marked, so the envelopes are the reorder buffer: the dispatch thread waits
+ * when the oldest item not collected is "window" items behind, and a full
+ * queue stops it or a worker the same way as everywhere else.
+ */
+typedef struct Sequencer Sequencer;
+
+/**
+ * Creates a sequencer.
+ * @param workers the number of workers.
+ * @param window the most items dispatched and not collected.
+ * @param sectorsPerQueue the number of sectors of every queue, at least 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @param policy how to pick the worker, one of SequencerPolicy.
+ * @return the sequencer, NULL on failure.
+ */
+Sequencer * createSequencer(int const workers, int const window,
+        int const sectorsPerQueue, int const itemsPerSector, int const policy);
+
+/**
+ * Gives an item to a worker, from the dispatch thread.
+ * @return On success 0, -1 otherwise (ENOMEM if the window or the queue of the
+ * worker is full).
+ */
+int sequencerDispatch(Sequencer * const sequencer, void * const item);
+
+/**
+ * Takes the next item of a worker, from the thread of that worker.
+ * @return the envelope of the item, NULL if there is none.
+ */
+SequencedItem * sequencerTake(Sequencer * const sequencer, int const worker);
+
+/**
+ * Gives back an envelope taken with 'sequencerTake', its result filled, from
+ * the thread of the worker.
+ * @return On success 0, -1 otherwise (ENOMEM if the output queue is full).
+ */
+int sequencerPut(Sequencer * const sequencer, int const worker,
+        SequencedItem * const envelope);
+
+/**
+ * Takes up to count results, in the order of the items, from the collect
+ * thread.
+ * @param results receives the results.
+ * @return the number of results, 0 while the next result is not back.
+ */
+int sequencerCollect(Sequencer * const sequencer, void ** const results, int const count);
+
+/**
+ * Releases the sequencer.
+ * Must be called when no thread uses it.
+ */
+void destroySequencer(Sequencer * const sequencer);
+
+#endif
@@ -0,0 +1,237 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ShmQueue.h"
+
+#define SHM_QUEUE_MAGIC 0x54545151u
+#define SHM_QUEUE_VERSION 1u
+#define SHM_QUEUE_LINE 64
+
+static size_t sectorBytes(int const itemsPerSector) {
+    return (sizeof(ShmSector) + itemsPerSector * sizeof(uint64_t)
+            + SHM_QUEUE_LINE - 1) / SHM_QUEUE_LINE * SHM_QUEUE_LINE;
+}
+
+static inline ShmSector * sectorAt(ShmQueue const * const queue, uint64_t const offset) {
+    return offset ? (ShmSector *)(queue->base + offset) : NULL;
+}
+
+size_t shmQueueSize(int const sectors, int const itemsPerSector) {
+    return sizeof(ShmQueueHeader) + sectors * sectorBytes(itemsPerSector);
+}
+
+int shmQueueCreate(ShmQueue * const queue, int const fd, int const sectors,
+        int const itemsPerSector) {
+    if (!queue || fd < 0 || sectors < 2 || itemsPerSector <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    register size_t const size = shmQueueSize(sectors, itemsPerSector);
+    if (ftruncate(fd, size)) return -1;
+    void * const base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == base) return -1;
+    queue->base = base;
+    queue->size = size;
+    queue->role = shmNone;
+    register ShmQueueHeader * const header = base;
+    memset(header, 0, sizeof(ShmQueueHeader));
+    header->segmentSize = size;
+    header->sectors = sectors;
+    header->itemsPerSector = itemsPerSector;
+    register uint64_t offset = sizeof(ShmQueueHeader);
+    header->writeHead = offset;
+    for (int i = 0; i < sectors; ++i, offset += sectorBytes(itemsPerSector)) {
+        register ShmSector * const sector = sectorAt(queue, offset);
+        sector->size = itemsPerSector;
+        sector->readCursor = sector->writeCursor = itemsPerSector;
+        sector->nextSector = i + 1 < sectors ? offset + sectorBytes(itemsPerSector) : 0;
+        header->write = header->read = offset;
+    }
+    header->version = SHM_QUEUE_VERSION;
+    __sync_synchronize();
+    header->magic = SHM_QUEUE_MAGIC;
+    return 0;
+}
+
+int shmQueueAttach(ShmQueue * const queue, int const fd) {
+    if (!queue || fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) return -1;
+    if ((size_t)st.st_size < sizeof(ShmQueueHeader)) {
+        errno = EINVAL;
+        return -1;
+    }
+    void * const base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == base) return -1;
+    register ShmQueueHeader const * const header = base;
+    if (header->magic != SHM_QUEUE_MAGIC || header->version != SHM_QUEUE_VERSION
+            || header->segmentSize != (uint64_t)st.st_size) {
+        munmap(base, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    queue->base = base;
+    queue->size = st.st_size;
+    queue->role = shmNone;
+    return 0;
+}
+
+static int processAlive(int const pid) {
+    return pid && (!kill(pid, 0) || errno != ESRCH);
+}
+
+/**
+ * Makes the chain whole after the death of a write process.
+ * The write process changes the chain only while recycling a sector and the
+ * sector is recorded in "recycling" for all that time.
+ */
+static void recoverWriter(ShmQueue * const queue) {
+    register ShmQueueHeader * const header = (ShmQueueHeader *)queue->base;
+    register ShmSector * const write = sectorAt(queue, header->write);
+    register uint64_t const recycling = header->recycling;
+    if (recycling && recycling != header->write) {
+        register ShmSector * const tmp = sectorAt(queue, recycling);
+        if (write->nextSector == recycling) {
+            /* Linked but not recorded as "write". */
+            header->write = recycling;
+        } else if (header->writeHead != recycling) {
+            /* Taken out of the spare sectors but not linked, put it back. */
+            tmp->readCursor = tmp->writeCursor = tmp->size;
+            tmp->nextSector = header->writeHead;
+            header->writeHead = recycling;
+        }
+    }
+    header->recycling = 0;
+    /* An empty sector that was reset only half way. */
+    register ShmSector * const tail = sectorAt(queue, header->write);
+    if (tail->writeCursor < tail->readCursor) tail->readCursor = tail->writeCursor;
+}
+
+static int claimRole(ShmQueue * const queue, ShmRole const role, int const takeOver) {
+    if (!queue || !queue->base || queue->role != shmNone
+            || (role != shmWriter && role != shmReader)) {
+        errno = EINVAL;
+        return -1;
+    }
+    register ShmQueueHeader * const header = (ShmQueueHeader *)queue->base;
+    int volatile * const owner = role == shmWriter ? &header->writerPid : &header->readerPid;
+    register int const me = getpid();
+    register int const previous = *owner;
+    if ((!takeOver && processAlive(previous))
+            || !__sync_bool_compare_and_swap(owner, previous, me)) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (role == shmWriter && previous) recoverWriter(queue);
+    queue->role = role;
+    return 0;
+}
+
+int shmQueueClaim(ShmQueue * const queue, ShmRole const role) {
+    return claimRole(queue, role, 0);
+}
+
+int shmQueueTakeOver(ShmQueue * const queue, ShmRole const role) {
+    return claimRole(queue, role, 1);
+}
+
+int shmQueuePeerAlive(ShmQueue const * const queue, ShmRole const role) {
+    if (!queue || !queue->base) return 0;
+    register ShmQueueHeader const * const header = (ShmQueueHeader const *)queue->base;
+    if (role == shmWriter) return processAlive(header->writerPid);
+    if (role == shmReader) return processAlive(header->readerPid);
+    return 0;
+}
+
+int shmWriteItem(ShmQueue * const queue, uint64_t const item) {
+    if (!queue || queue->role != shmWriter) {
+        errno = EINVAL;
+        return -1;
+    }
+    register ShmQueueHeader * const header = (ShmQueueHeader *)queue->base;
+    register ShmSector * const write = sectorAt(queue, header->write);
+    if (header->read == header->write && write->writeCursor == write->readCursor) {
+        write->writeCursor = 0;
+        write->readCursor = 0;
+    }
+    if (write->writeCursor < write->size) {
+        write->items[write->writeCursor] = item;
+        ++write->writeCursor;
+        return 0;
+    }
+    if (header->writeHead == header->read || header->writeHead == header->write) {
+        errno = ENOMEM;
+        return -1;
+    }
+    register ShmSector * const tmp = sectorAt(queue, header->writeHead);
+    header->recycling = header->writeHead;
+    header->writeHead = tmp->nextSector;
+    tmp->nextSector = 0;
+    tmp->writeCursor = 0;
+    tmp->readCursor = 0;
+    tmp->items[0] = item;
+    tmp->writeCursor = 1;
+    write->nextSector = header->recycling;
+    header->write = header->recycling;
+    header->recycling = 0;
+    return 0;
+}
+
+int shmReadItem(ShmQueue * const queue, uint64_t * const item) {
+    if (!queue || queue->role != shmReader || !item) {
+        errno = EINVAL;
+        return -1;
+    }
+    register ShmQueueHeader * const header = (ShmQueueHeader *)queue->base;
+    register ShmSector * tmpRead = sectorAt(queue, header->read);
+    for (;;) {
+        if (tmpRead->readCursor < tmpRead->writeCursor) {
+            *item = tmpRead->items[tmpRead->readCursor];
+            ++tmpRead->readCursor;
+            return 0;
+        }
+        if (tmpRead->readCursor < tmpRead->size || !tmpRead->nextSector) break;
+        header->read = tmpRead->nextSector;
+        tmpRead = sectorAt(queue, header->read);
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+int shmQueueDetach(ShmQueue * const queue) {
+    if (!queue || !queue->base) {
+        errno = EINVAL;
+        return -1;
+    }
+    register ShmQueueHeader * const header = (ShmQueueHeader *)queue->base;
+    if (queue->role == shmWriter) header->writerPid = 0;
+    if (queue->role == shmReader) header->readerPid = 0;
+    munmap(queue->base, queue->size);
+    *queue = mkShmQueue();
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include<stddef.h>
+#include<stdint.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHM_QUEUE_H
+#define SHM_QUEUE_H
+
+/**
+ * The position independent twin of QueueSector.
+ * Links are offsets from the start of the segment, 0 meaning NULL, so the
+ * segment can be mapped at different addresses in different processes.
+ * Items are 64 bit values, pointers mean nothing in the other process.
+ */
+typedef struct ShmSector {
+    int size;
+    int volatile readCursor;
+    int volatile writeCursor;
+    int unused;
+    uint64_t volatile nextSector;
+    uint64_t volatile items[];
+} ShmSector;
+
+/**
+ * The start of the segment, the twin of Queue.
+ * The fields of the write process and the fields of the read process are on
+ * separate cache lines.
+ *
+ * All the sectors are laid out by 'shmQueueCreate', there is no submit and no
+ * recover, so Queue.activeRead is not needed: "read" is never NULL.
+ */
+typedef struct ShmQueueHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t segmentSize;
+    int sectors;
+    int itemsPerSector;
+    char unused[40];
+    /** Mutated only by the write process. */
+    uint64_t volatile writeHead;
+    /** Mutated only by the write process. */
+    uint64_t volatile write;
+    /**
+     * The sector being recycled by the write process, 0 when none.
+     * It is the journal used to finish or undo a recycle interrupted by the
+     * death of the write process.
+     */
+    uint64_t volatile recycling;
+    /** The pid of the write process, 0 when there is none. */
+    int volatile writerPid;
+    char unused2[36];
+    /** Mutated only by the read process. */
+    uint64_t volatile read;
+    /** The pid of the read process, 0 when there is none. */
+    int volatile readerPid;
+    char unused3[52];
+} ShmQueueHeader;
+
+/** The roles a process can take on a shared queue. */
+typedef enum ShmRole {
+    shmNone,
+    shmWriter,
+    shmReader
+} ShmRole;
+
+/** The handle of a process to a shared queue. */
+typedef struct ShmQueue {
+    /** Where the segment is mapped in this process. */
+    char * base;
+    /** The size of the mapping. */
+    size_t size;
+    /** The role claimed by this process. */
+    ShmRole role;
+} ShmQueue;
+
+/** Creates a handle that is not attached to any segment. */
+static inline ShmQueue mkShmQueue() {
+    ShmQueue const tmp = {NULL, 0, shmNone};
+    return tmp;
+}
+
+/**
+ * The size in bytes of a segment holding a queue of sectors * itemsPerSector.
+ */
+size_t shmQueueSize(int const sectors, int const itemsPerSector);
+
+/**
+ * Lays out a new queue in a shared memory file (memfd_create, shm_open or
+ * a regular file) and maps it.
+ * The file is resized to 'shmQueueSize'.
+ * @param queue the handle to fill.
+ * @param fd the file.
+ * @param sectors the number of sectors, at least 2.
+ * @param itemsPerSector the number of items in every sector.
+ * @return On success 0, -1 otherwise.
+ */
+int shmQueueCreate(ShmQueue * const queue, int const fd, int const sectors,
+        int const itemsPerSector);
+
+/**
+ * Maps a queue made by 'shmQueueCreate', in this or in another process.
+ * @param queue the handle to fill.
+ * @param fd the file.
+ * @return On success 0, -1 otherwise (EINVAL if the file holds no queue).
+ */
+int shmQueueAttach(ShmQueue * const queue, int const fd);
+
+/**
+ * Takes the write or the read role of the queue.
+ * The role is free if nobody has it or if the process that had it is dead.
+ * Taking the write role from a dead process finishes or undoes the operation
+ * that process was doing, so the chain of sectors is whole again.
+ * @param queue the handle.
+ * @param role shmWriter or shmReader.
+ * @return On success 0, -1 otherwise (EBUSY if a live process has the role).
+ */
+int shmQueueClaim(ShmQueue * const queue, ShmRole const role);
+
+/**
+ * Takes a role whose process the caller knows to be dead, for example from a
+ * lock the process held on the file, even if its pid was given to another
+ * process meanwhile. The operation of the dead process is finished or undone
+ * as in 'shmQueueClaim'.
+ * @param queue the handle.
+ * @param role shmWriter or shmReader.
+ * @return On success 0, -1 otherwise (EBUSY if another process took the role
+ * at the same time).
+ */
+int shmQueueTakeOver(ShmQueue * const queue, ShmRole const role);
+
+/**
+ * Tells if the process that has a role is alive.
+ * @return 1 if it is, 0 if the role is free or its process is dead.
+ */
+int shmQueuePeerAlive(ShmQueue const * const queue, ShmRole const role);
+
+/**
+ * Writes a value, the same as 'writeItem'.
+ * If the write process dies in the middle the value can be lost or, if the
+ * sector was already linked, delivered although the call never returned.
+ * @return On success 0, -1 otherwise (ENOMEM if the queue is full).
+ */
+int shmWriteItem(ShmQueue * const queue, uint64_t const item);
+
+/**
+ * Reads a value, the same as 'readItem'.
+ * The read cursor moves after the value is taken, so if the read process dies
+ * in the middle the next read process gets the value again.
+ * @return On success 0, -1 otherwise (EAGAIN if the queue is empty).
+ */
+int shmReadItem(ShmQueue * const queue, uint64_t * const item);
+
+/**
+ * Gives back the role and unmaps the segment.
+ * @return On success 0, -1 otherwise.
+ */
+int shmQueueDetach(ShmQueue * const queue);
+
+#endif
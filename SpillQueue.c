@@ -0,0 +1,210 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "SpillQueue.h"
+
+/** Every entry in a segment starts at a multiple of this. */
+#define SPILL_ALIGN 8
+
+/**
+ * A segment file.
+ * The bytes up to "written" are published by the write thread, "next" is set
+ * before the first entry of the next segment is published.
+ * The write thread lets go of a segment once "next" is set, from then on the
+ * read thread owns it and releases it when drained.
+ */
+typedef struct SpillSegment {
+    char * base;
+    size_t size;
+    size_t volatile written;
+    struct SpillSegment * volatile next;
+} SpillSegment;
+
+struct SpillQueue {
+    Queue * queue;
+    SpillMode mode;
+    size_t segmentSize;
+    char * directory;
+    /** The segment being appended, handled only by the write thread. */
+    SpillSegment * writeSegment;
+    /** The number of spilled items, mutated only by the write thread. */
+    unsigned long volatile spilled;
+    char unused[64];
+    /** The segment being drained, handled only by the read thread. */
+    SpillSegment * readSegment;
+    size_t readOffset;
+    /** The number of spilled items read, mutated only by the read thread. */
+    unsigned long volatile drained;
+    /**
+     * 1 once the in memory queue gave QUEUE_END, it is not read after that,
+     * handled only by the read thread.
+     */
+    int ended;
+};
+
+static SpillSegment * makeSegment(SpillQueue const * const queue) {
+    register size_t const length = strlen(queue->directory);
+    char * const path = malloc(length + sizeof("/spill-XXXXXX"));
+    if (!path) return NULL;
+    sprintf(path, "%s/spill-XXXXXX", queue->directory);
+    register int const fd = mkstemp(path);
+    if (fd < 0) {
+        free(path);
+        return NULL;
+    }
+    unlink(path);
+    free(path);
+    SpillSegment * const segment = calloc(1, sizeof(SpillSegment));
+    if (!segment || ftruncate(fd, queue->segmentSize)) {
+        free(segment);
+        close(fd);
+        return NULL;
+    }
+    segment->base = mmap(NULL, queue->segmentSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == segment->base) {
+        free(segment);
+        return NULL;
+    }
+    madvise(segment->base, queue->segmentSize, MADV_SEQUENTIAL);
+    segment->size = queue->segmentSize;
+    return segment;
+}
+
+static void dropSegment(SpillSegment * const segment) {
+    munmap(segment->base, segment->size);
+    free(segment);
+}
+
+static size_t entrySize(SpillQueue const * const queue, void const * const item) {
+    if (queue->mode == spillValues) return sizeof(void*);
+    return (sizeof(SpillRecord) + ((SpillRecord const *)item)->length
+            + SPILL_ALIGN - 1) / SPILL_ALIGN * SPILL_ALIGN;
+}
+
+SpillQueue * createSpillQueue(Queue * const queue, SpillMode const mode,
+        char const * const directory, size_t const segmentSize) {
+    if (!queue || (mode != spillValues && mode != spillRecords) || !directory
+            || segmentSize < SPILL_ALIGN || segmentSize % SPILL_ALIGN) {
+        errno = EINVAL;
+        return NULL;
+    }
+    SpillQueue * const tmp = calloc(1, sizeof(SpillQueue));
+    if (!tmp) return NULL;
+    tmp->directory = strdup(directory);
+    if (!tmp->directory) {
+        free(tmp);
+        return NULL;
+    }
+    tmp->queue = queue;
+    tmp->mode = mode;
+    tmp->segmentSize = segmentSize;
+    return tmp;
+}
+
+static int appendSpill(SpillQueue * const queue, void * const item) {
+    register size_t const size = entrySize(queue, item);
+    if (size > queue->segmentSize) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    register SpillSegment * segment = queue->writeSegment;
+    if (!segment || segment->written + size > segment->size) {
+        SpillSegment * const fresh = makeSegment(queue);
+        if (!fresh) return -1;
+        if (segment) segment->next = fresh;
+        else queue->readSegment = fresh;
+        queue->writeSegment = segment = fresh;
+    }
+    register char * const entry = segment->base + segment->written;
+    if (queue->mode == spillValues) *(void **)entry = item;
+    else memcpy(entry, item, sizeof(SpillRecord) + ((SpillRecord const *)item)->length);
+    segment->written += size;
+    ++queue->spilled;
+    return 0;
+}
+
+int spillWriteItem(SpillQueue * const queue, void * const item) {
+    if (!queue || !item) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (queue->spilled == queue->drained) {
+        if (0 == writeItem(queue->queue, item)) return 0;
+        if (errno != ENOMEM) return -1;
+    }
+    return appendSpill(queue, item) ? -1 : 1;
+}
+
+static void * takeSpill(SpillQueue * const queue) {
+    register SpillSegment * segment = queue->readSegment;
+    if (queue->readOffset == segment->written) {
+        /* An item is pending, so it is in the next segment. */
+        register SpillSegment * const next = segment->next;
+        dropSegment(segment);
+        queue->readSegment = segment = next;
+        queue->readOffset = 0;
+    }
+    register char * const entry = segment->base + queue->readOffset;
+    register void * const item = queue->mode == spillValues
+        ? *(void **)entry : (void *)entry;
+    queue->readOffset += entrySize(queue, item);
+    ++queue->drained;
+    return item;
+}
+
+void * spillReadItem(SpillQueue * const queue) {
+    if (!queue) return NULL;
+    /* The close was acknowledged, the writer may already reuse the queue. */
+    if (queue->ended) return queue->drained == queue->spilled ? QUEUE_END : takeSpill(queue);
+    register void * item = readItem(queue->queue);
+    if (item == QUEUE_END) queue->ended = 1;
+    else if (item) return item;
+    if (queue->drained == queue->spilled) return item;
+    /* The in memory items written before the spill started come first. */
+    if (!item) {
+        item = readItem(queue->queue);
+        if (item == QUEUE_END) queue->ended = 1;
+        else if (item) return item;
+    }
+    /* A closed queue ends after the spilled items. */
+    return takeSpill(queue);
+}
+
+unsigned long spillPending(SpillQueue const * const queue) {
+    return queue->spilled - queue->drained;
+}
+
+void destroySpillQueue(SpillQueue * const queue) {
+    if (!queue) return;
+    for (SpillSegment * segment = queue->readSegment; segment;) {
+        SpillSegment * const next = segment->next;
+        dropSegment(segment);
+        segment = next;
+    }
+    free(queue->directory);
+    free(queue);
+}
@@ -0,0 +1,97 @@
+#include<stddef.h>
+#include<stdint.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPILL_QUEUE_H
+#define SPILL_QUEUE_H
+
+#include "TransThread.h"
+
+/** What goes to the disk when an item is spilled. */
+typedef enum SpillMode {
+    /** The item itself, 8 bytes. */
+    spillValues,
+    /** The SpillRecord the item points to, header and data. */
+    spillRecords
+} SpillMode;
+
+/** The shape of the items of a spillRecords queue. */
+typedef struct SpillRecord {
+    /** The number of bytes in data. */
+    uint32_t length;
+    unsigned char data[];
+} SpillRecord;
+
+/**
+ * A queue with an overflow tier on the disk.
+ *
+ * As long as the in memory queue has room nothing changes. When 'writeItem'
+ * fails with ENOMEM the write thread appends the item, and every item after
+ * it, to memory mapped segment files. It goes back to the in memory queue only
+ * after the read thread drained all the spilled items.
+ *
+ * The read thread always looks into the in memory queue first, the items that
+ * were there before the spill started come out first. When that queue is
+ * empty and there are spilled items it takes them, in order.
+ */
+typedef struct SpillQueue SpillQueue;
+
+/**
+ * Adds an overflow tier to a queue.
+ * @param queue the in memory queue, still owned by the caller.
+ * @param mode what to write into the segments.
+ * @param directory where to create the segment files, they are unlinked
+ * as soon as they are created.
+ * @param segmentSize the size of every segment file.
+ * @return the spill queue, NULL on failure.
+ */
+SpillQueue * createSpillQueue(Queue * const queue, SpillMode const mode,
+        char const * const directory, size_t const segmentSize);
+
+/**
+ * Writes an item, into the memory if the queue is not spilling and there is
+ * room, to the disk otherwise.
+ * @param queue the spill queue.
+ * @param item the item, not NULL.
+ * @return 0 if the item went into the memory, 1 if it was spilled (in the
+ * spillRecords mode the record was copied and still belongs to the caller),
+ * -1 on failure.
+ */
+int spillWriteItem(SpillQueue * const queue, void * const item);
+
+/**
+ * Reads the next item.
+ * In the spillRecords mode a spilled item points into the segment and is valid
+ * until the next call.
+ * @return the item, NULL if the queue is empty, QUEUE_END if the in memory
+ * queue was closed and all the items, spilled ones too, were read.
+ */
+void * spillReadItem(SpillQueue * const queue);
+
+/** @return the number of spilled items not read yet. */
+unsigned long spillPending(SpillQueue const * const queue);
+
+/**
+ * Releases the overflow tier, the in memory queue is left as it is.
+ * Must be called when neither thread uses the queue.
+ */
+void destroySpillQueue(SpillQueue * const queue);
+
+#endif
@@ -0,0 +1,316 @@
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ThreadPool.h"
+
+/** The size of a cache line, used to keep the threads off each other's data. */
+#define POOL_LINE 64
+
+/**
+ * The states of PoolWorker.hungry.
+ * Any value from claimedBy up means that the worker (value - claimedBy) is
+ * writing into the donation queue.
+ */
+enum { notHungry = 0, isHungry = 1, claimedBy = 2 };
+
+typedef struct PoolWorker {
+    pthread_t thread;
+    ThreadPool * pool;
+    int index;
+    /** The submitter from which to start taking items, for fairness. */
+    int nextSubmitter;
+    /** The queue through which the busy workers give items to this one. */
+    Queue donation;
+    /**
+     * The stealing flag.
+     * Set from notHungry to isHungry only by this worker, claimed from isHungry
+     * only by a donor (with a compare and swap) and given back to notHungry
+     * by that donor.
+     */
+    int volatile hungry;
+    /** Written only by this worker. */
+    unsigned long volatile completed;
+    /** Written only by this worker. */
+    unsigned long volatile stolen;
+} __attribute__((aligned(POOL_LINE))) PoolWorker;
+
+typedef struct PoolSubmitter {
+    /** Written only by the submitter. */
+    unsigned long volatile submitted;
+    /** The worker that gets the next item. */
+    int next;
+} __attribute__((aligned(POOL_LINE))) PoolSubmitter;
+
+struct ThreadPool {
+    PoolConfig config;
+    /** Set by 'destroyThreadPool' to make the workers exit when idle. */
+    int volatile stop;
+    PoolWorker * workers;
+    PoolSubmitter * submitters;
+    /** The queue from submitter s to worker w is queues[s * workers + w]. */
+    Queue * queues;
+    /** The memory of all the sectors. */
+    void * sectors;
+};
+
+static int takeItems(ThreadPool * const pool, PoolWorker * const self,
+        void ** const batch) {
+    register int const limit = pool->config.batch;
+    register int got = readItems(&self->donation, batch, limit);
+    /* The queues are never closed, but a -1 must not count. */
+    if (got < 0) got = 0;
+    self->stolen += got;
+    register int const submitters = pool->config.submitters;
+    for (int i = 0; i < submitters && got < limit; ++i) {
+        register int const s = (self->nextSubmitter + i) % submitters;
+        register int const taken = readItems(&pool->queues[s * pool->config.workers + self->index],
+                batch + got, limit - got);
+        if (taken > 0) got += taken;
+    }
+    self->nextSubmitter = (self->nextSubmitter + 1) % submitters;
+    return got;
+}
+
+/**
+ * Gives the second half of a batch to a hungry worker, if there is any.
+ * @return the number of items that remain to be handled by this worker.
+ */
+static int donate(ThreadPool * const pool, PoolWorker * const self,
+        void ** const batch, int const count) {
+    register int const workers = pool->config.workers;
+    for (int i = 1; i < workers; ++i) {
+        register PoolWorker * const peer = &pool->workers[(self->index + i) % workers];
+        if (peer->hungry != isHungry) continue;
+        if (!__sync_bool_compare_and_swap(&peer->hungry, isHungry,
+                    claimedBy + self->index)) continue;
+        register int const half = count / 2;
+        register int given = writeItems(&peer->donation, batch + count - half, half);
+        peer->hungry = notHungry;
+        if (given < 0) given = 0;
+        /* The donation queue took only a part: the rest stays with us. */
+        if (given < half)
+            memmove(batch + count - half, batch + count - half + given,
+                    sizeof(void *) * (half - given));
+        return count - given;
+    }
+    return count;
+}
+
+static void * workerMain(void * const arg) {
+    register PoolWorker * const self = arg;
+    register ThreadPool * const pool = self->pool;
+    void ** const batch = malloc(sizeof(void*) * pool->config.batch);
+    if (!batch) abort();
+    for (;;) {
+        register int count = takeItems(pool, self, batch);
+        if (!count) {
+            if (pool->stop) {
+                __sync_bool_compare_and_swap(&self->hungry, isHungry, notHungry);
+                if (self->hungry == notHungry) {
+                    count = takeItems(pool, self, batch);
+                    if (!count) break;
+                }
+            } else if (self->hungry == notHungry) {
+                self->hungry = isHungry;
+            }
+            if (!count) {
+                sched_yield();
+                continue;
+            }
+        }
+        if (self->hungry == isHungry)
+            __sync_bool_compare_and_swap(&self->hungry, isHungry, notHungry);
+        if (count == pool->config.batch && count > 1)
+            count = donate(pool, self, batch, count);
+        for (int i = 0; i < count; ++i)
+            pool->config.handler(batch[i], pool->config.context);
+        self->completed += count;
+    }
+    free(batch);
+    return NULL;
+}
+
+static void releasePool(ThreadPool * const pool) {
+    free(pool->sectors);
+    free(pool->queues);
+    free(pool->submitters);
+    free(pool->workers);
+    free(pool);
+}
+
+ThreadPool * createThreadPool(PoolConfig const * const config) {
+    if (!config || config->workers <= 0 || config->submitters <= 0
+            || config->sectorsPerQueue < 2 || config->itemsPerSector <= 0
+            || config->batch <= 0 || !config->handler) {
+        errno = EINVAL;
+        return NULL;
+    }
+    register int const workers = config->workers;
+    register int const queueCount = config->submitters * workers + workers;
+    register size_t const sectorSize = (QUEUE_SECTOR_SIZE(config->itemsPerSector)
+            + POOL_LINE - 1) / POOL_LINE * POOL_LINE;
+    ThreadPool * const pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    pool->config = *config;
+    pool->config.cpus = NULL;
+    if (posix_memalign((void**)&pool->workers, POOL_LINE, sizeof(PoolWorker) * workers)
+            || posix_memalign((void**)&pool->submitters, POOL_LINE,
+                sizeof(PoolSubmitter) * config->submitters)
+            || posix_memalign(&pool->sectors, POOL_LINE,
+                sectorSize * config->sectorsPerQueue * queueCount)
+            || !(pool->queues = malloc(sizeof(Queue) * config->submitters * workers))) {
+        releasePool(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(pool->workers, 0, sizeof(PoolWorker) * workers);
+    memset(pool->submitters, 0, sizeof(PoolSubmitter) * config->submitters);
+    register char * sector = pool->sectors;
+    for (int q = 0; q < queueCount; ++q) {
+        Queue * const queue = q < config->submitters * workers
+            ? &pool->queues[q] : &pool->workers[q - config->submitters * workers].donation;
+        *queue = mkQueue();
+        for (int i = 0; i < config->sectorsPerQueue; ++i, sector += sectorSize)
+            submitSector(queue, sector, sectorSize);
+    }
+    for (int s = 0; s < config->submitters; ++s)
+        pool->submitters[s].next = s % workers;
+    for (int w = 0; w < workers; ++w) {
+        register PoolWorker * const worker = &pool->workers[w];
+        worker->pool = pool;
+        worker->index = w;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (config->cpus && config->cpus[w] >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(config->cpus[w], &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        }
+        register int const error = pthread_create(&worker->thread, &attr, workerMain, worker);
+        pthread_attr_destroy(&attr);
+        if (error) {
+            pool->stop = 1;
+            for (int i = 0; i < w; ++i) pthread_join(pool->workers[i].thread, NULL);
+            releasePool(pool);
+            errno = error;
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+int poolSubmitTo(ThreadPool * const pool, int const submitter,
+        int const worker, void * const item) {
+    if (!pool || submitter < 0 || submitter >= pool->config.submitters
+            || worker < 0 || worker >= pool->config.workers || !item) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (writeItem(&pool->queues[submitter * pool->config.workers + worker], item))
+        return -1;
+    ++pool->submitters[submitter].submitted;
+    return 0;
+}
+
+int poolSubmit(ThreadPool * const pool, int const submitter, void * const item) {
+    if (!pool || submitter < 0 || submitter >= pool->config.submitters || !item) {
+        errno = EINVAL;
+        return -1;
+    }
+    register PoolSubmitter * const self = &pool->submitters[submitter];
+    register int const workers = pool->config.workers;
+    for (int i = 0; i < workers; ++i) {
+        register int const w = self->next;
+        self->next = (w + 1) % workers;
+        if (0 == writeItem(&pool->queues[submitter * workers + w], item)) {
+            ++self->submitted;
+            return 0;
+        }
+    }
+    errno = ENOMEM;
+    return -1;
+}
+
+int poolSubmitBatch(ThreadPool * const pool, int const submitter,
+        void * const * const items, int const count) {
+    if (!pool || submitter < 0 || submitter >= pool->config.submitters
+            || !items || count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    register PoolSubmitter * const self = &pool->submitters[submitter];
+    register int const workers = pool->config.workers;
+    register int const chunk = (count + workers - 1) / workers;
+    register int done = 0;
+    register int idle = 0;
+    while (done < count && idle < workers) {
+        register int const w = self->next;
+        self->next = (w + 1) % workers;
+        register int const written = writeItems(
+                &pool->queues[submitter * workers + w], items + done,
+                chunk < count - done ? chunk : count - done);
+        idle = written ? 0 : idle + 1;
+        done += written;
+    }
+    self->submitted += done;
+    if (done < count) errno = ENOMEM;
+    return done;
+}
+
+unsigned long poolSubmitted(ThreadPool const * const pool) {
+    register unsigned long total = 0;
+    for (int s = 0; s < pool->config.submitters; ++s)
+        total += pool->submitters[s].submitted;
+    return total;
+}
+
+unsigned long poolCompleted(ThreadPool const * const pool) {
+    register unsigned long total = 0;
+    for (int w = 0; w < pool->config.workers; ++w)
+        total += pool->workers[w].completed;
+    return total;
+}
+
+unsigned long poolWorkerCompleted(ThreadPool const * const pool, int const worker) {
+    return pool->workers[worker].completed;
+}
+
+unsigned long poolWorkerStolen(ThreadPool const * const pool, int const worker) {
+    return pool->workers[worker].stolen;
+}
+
+void poolWait(ThreadPool const * const pool) {
+    register unsigned long const target = poolSubmitted(pool);
+    while (poolCompleted(pool) < target) sched_yield();
+}
+
+void destroyThreadPool(ThreadPool * const pool) {
+    if (!pool) return;
+    pool->stop = 1;
+    for (int w = 0; w < pool->config.workers; ++w)
+        pthread_join(pool->workers[w].thread, NULL);
+    releasePool(pool);
+}
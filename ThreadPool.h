@@ -0,0 +1,139 @@
+#include<stddef.h>
+/*
+Copyright (C) 2007-2019 Eduard Timotei BUDULEA
+
+This file is part of TransThread.h
+
+TransThread is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Foobar is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "TransThread.h"
+
+/**
+ * The function that a worker runs for every item submitted to the pool.
+ * @param item the item as it was submitted.
+ * @param context the context given in the pool configuration.
+ */
+typedef void (*PoolHandler)(void * item, void * context);
+
+/** How to build a thread pool. */
+typedef struct PoolConfig {
+    /** The number of worker threads. */
+    int workers;
+    /**
+     * The number of submitting threads.
+     * Every submitter gets its own queue to every worker, so a submitter
+     * index must be used by only one thread at a time.
+     */
+    int submitters;
+    /** The number of sectors in every queue, at least 2. */
+    int sectorsPerQueue;
+    /** The number of items in every sector. */
+    int itemsPerSector;
+    /** The maximum number of items a worker takes from its queues at once. */
+    int batch;
+    /**
+     * The CPU on which to pin every worker, NULL or a negative entry leaves
+     * the worker unpinned.
+     */
+    int const * cpus;
+    /** The function run for every item. */
+    PoolHandler handler;
+    /** The second argument of the handler. */
+    void * context;
+} PoolConfig;
+
+/**
+ * A set of worker threads fed through TransThread queues.
+ *
+ * Every (submitter, worker) pair has its own queue, so every queue keeps a
+ * single write thread and a single read thread.
+ *
+ * Stealing does not break this: an idle worker raises its "hungry" flag and
+ * a busy worker that sees it claims the idle worker's donation queue, moves
+ * a part of its current batch there and then gives the claim back.
+ * So the donation queue has a single write thread at any moment and the
+ * claim is the hand over between them.
+ */
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * Creates the pool and starts its workers.
+ * @param config the pool configuration.
+ * @return the pool, NULL on failure (EINVAL, ENOMEM or the pthread error).
+ */
+ThreadPool * createThreadPool(PoolConfig const * const config);
+
+/**
+ * Submits an item to the next worker of this submitter, in round robin.
+ * If the queue of that worker is full the following workers are tried.
+ * @param pool the pool.
+ * @param submitter the index of the submitting thread.
+ * @param item the item, it can not be NULL.
+ * @return On success 0, -1 otherwise (ENOMEM if all the queues are full).
+ */
+int poolSubmit(ThreadPool * const pool, int const submitter, void * const item);
+
+/**
+ * Submits an item to a given worker.
+ * @param pool the pool.
+ * @param submitter the index of the submitting thread.
+ * @param worker the index of the worker.
+ * @param item the item, it can not be NULL.
+ * @return On success 0, -1 otherwise (ENOMEM if the queue is full).
+ */
+int poolSubmitTo(ThreadPool * const pool, int const submitter,
+        int const worker, void * const item);
+
+/**
+ * Submits a batch of items, spread in chunks over the workers.
+ * @param pool the pool.
+ * @param submitter the index of the submitting thread.
+ * @param items the items, none of them can be NULL.
+ * @param count the number of items.
+ * @return the number of items submitted, less then count if all the queues
+ * got full (ENOMEM), -1 on invalid arguments.
+ */
+int poolSubmitBatch(ThreadPool * const pool, int const submitter,
+        void * const * const items, int const count);
+
+/** @return the number of items submitted by all the submitters. */
+unsigned long poolSubmitted(ThreadPool const * const pool);
+
+/** @return the number of items finished by all the workers. */
+unsigned long poolCompleted(ThreadPool const * const pool);
+
+/** @return the number of items finished by a worker. */
+unsigned long poolWorkerCompleted(ThreadPool const * const pool, int const worker);
+
+/** @return the number of items a worker took from the busy workers. */
+unsigned long poolWorkerStolen(ThreadPool const * const pool, int const worker);
+
+/**
+ * Waits until every submitted item is finished.
+ * Must be called when no submitter is active.
+ */
+void poolWait(ThreadPool const * const pool);
+
+/**
+ * Stops the workers after they finish all the submitted items and releases
+ * the pool.
+ * Must be called when no submitter is active.
+ */
+void destroyThreadPool(ThreadPool * const pool);
+
+#endif
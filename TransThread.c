@@ -19,7 +19,9 @@ along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
 #include <assert.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "ItemCopy.h"
 #include "TransThread.h"
 
 #ifdef USE_CORO_TEST
@@ -34,6 +36,18 @@ void yield_write();
 
 #endif
 
+#ifdef __GNUC__
+
+#define prefetch_read(address) __builtin_prefetch((address), 0, 3)
+#define prefetch_write(address) __builtin_prefetch((address), 1, 3)
+
+#else
+
+#define prefetch_read(address)
+#define prefetch_write(address)
+
+#endif
+
 typedef struct QueueSector{
     int const size;
     int volatile readCursor;
@@ -42,8 +56,240 @@ typedef struct QueueSector{
     void * volatile items[];
 } QueueSector;
 
+/** @return the size in bytes of an item in the sectors of the queue. */
+static inline int itemWidth(Queue const * const queue) {
+    return queue->handleWidth ? queue->handleWidth : (int)sizeof(void *);
+}
+
+/** @return the item at index in the sector, turned back from a handle. */
+static inline void * loadItem(Queue const * const queue,
+        QueueSector const * const sector, int const index) {
+    switch (queue->handleWidth) {
+    case 4:
+        return (void *)((uintptr_t)queue->handleBase
+                + ((uintptr_t)((uint32_t const volatile *)sector->items)[index]
+                    << queue->handleShift));
+    case 2:
+        return (void *)((uintptr_t)queue->handleBase
+                + ((uintptr_t)((uint16_t const volatile *)sector->items)[index]
+                    << queue->handleShift));
+    default:
+        return sector->items[index];
+    }
+}
+
+/** Puts an item at index in the sector, as a handle if the queue keeps them. */
+static inline void storeItem(Queue const * const queue, QueueSector * const sector,
+        int const index, void * const item) {
+    switch (queue->handleWidth) {
+    case 4:
+        ((uint32_t volatile *)sector->items)[index] =
+            ((uintptr_t)item - (uintptr_t)queue->handleBase) >> queue->handleShift;
+        break;
+    case 2:
+        ((uint16_t volatile *)sector->items)[index] =
+            ((uintptr_t)item - (uintptr_t)queue->handleBase) >> queue->handleShift;
+        break;
+    default:
+        sector->items[index] = item;
+    }
+}
+
+/** Copies count items of the sector, from index on, into out. */
+static inline void loadItems(Queue const * const queue, QueueSector const * const sector,
+        int const index, void ** const out, int const count) {
+    if (!queue->handleWidth) {
+        if (count >= ITEM_COPY_MIN) copyItems(out, (void * const *)sector->items + index, count);
+        else for (int i = 0; i < count; ++i) out[i] = sector->items[index + i];
+        return;
+    }
+    for (int i = 0; i < count; ++i) out[i] = loadItem(queue, sector, index + i);
+}
+
+/** Copies count items into the sector, from index on. */
+static inline void storeItems(Queue const * const queue, QueueSector * const sector,
+        int const index, void * const * const in, int const count) {
+    if (!queue->handleWidth) {
+        if (queue->streamBatch && count >= queue->streamBatch)
+            streamItems((void **)sector->items + index, in, count);
+        else if (count >= ITEM_COPY_MIN)
+            copyItems((void **)sector->items + index, in, count);
+        else for (int i = 0; i < count; ++i) sector->items[index + i] = in[i];
+        return;
+    }
+    for (int i = 0; i < count; ++i) storeItem(queue, sector, index + i, in[i]);
+}
+
+/** @return true if the queue keeps pointers, or handles of a width and a shift it can use. */
+static inline bool validHandles(Queue const * const queue) {
+    if (!queue->handleWidth) return true;
+    return (queue->handleWidth == 4 || queue->handleWidth == 2)
+        && queue->handleShift >= 0 && queue->handleShift < 8 * (int)sizeof(uintptr_t);
+}
+
+/**
+ * @return true if every item is a handle the queue can keep.
+ * The queue must pass 'validHandles'.
+ */
+static bool fitHandles(Queue const * const queue, void * const * const items, int const count) {
+    if (!queue->handleWidth) return true;
+    register uintptr_t const low = ((uintptr_t)1 << queue->handleShift) - 1;
+    register uint64_t const last = ((uint64_t)1 << 8 * queue->handleWidth) - 1;
+    for (int i = 0; i < count; ++i) {
+        register uintptr_t const offset = (uintptr_t)items[i] - (uintptr_t)queue->handleBase;
+        if ((offset & low) || (uint64_t)(offset >> queue->handleShift) > last) return false;
+    }
+    return true;
+}
+
+/**
+ * Prefetches what the read thread needs "prefetchDistance" items after the
+ * cursor: an item of this sector or the head of the next one.
+ */
+static inline void prefetchAfterRead(Queue const * const queue,
+        QueueSector const * const sector, int const cursor) {
+    register int const ahead = cursor + queue->prefetchDistance;
+    if (ahead < sector->size)
+        prefetch_read((char const *)sector->items + ahead * itemWidth(queue));
+    else if (sector->nextSector) prefetch_read((void const *)sector->nextSector);
+}
+
+/**
+ * Prefetches, for writing, the spare sector that the write thread recycles
+ * when the cursor gets to the end of the sector.
+ */
+static inline void prefetchBeforeRecycle(Queue const * const queue,
+        QueueSector const * const sector, int const cursor) {
+    if (cursor + queue->prefetchDistance < sector->size) return;
+    if (queue->hotSectors)
+        prefetch_write((void const *)queue->hotSectors);
+    else if (queue->writeHead != queue->read && queue->writeHead != queue->write)
+        prefetch_write((void const *)queue->writeHead);
+}
+
+/**
+ * Takes out of the chain the spare sector to recycle, as the policy says.
+ * @return the sector, NULL if there is no spare sector.
+ */
+static QueueSector * takeSpareSector(Queue * const queue) {
+    if (queue->recyclePolicy == recycleLifo) {
+        /* The read thread is past them, they are ours. */
+        while (queue->writeHead != queue->read && queue->writeHead != queue->write) {
+            yield_write();
+            register QueueSector * const tmp = queue->writeHead;
+            yield_write();
+            queue->writeHead = tmp->nextSector;
+            yield_write();
+            tmp->nextSector = queue->hotSectors;
+            yield_write();
+            queue->hotSectors = tmp;
+            yield_write();
+        }
+        register QueueSector * const tmp = queue->hotSectors;
+        if (!tmp) return NULL;
+        yield_write();
+        queue->hotSectors = tmp->nextSector;
+        yield_write();
+        tmp->nextSector = NULL;
+        yield_write();
+        return tmp;
+    }
+    if (queue->writeHead == queue->read || queue->writeHead == queue->write) return NULL;
+    yield_write();
+    register QueueSector * const tmp = queue->writeHead;
+    yield_write();
+    queue->writeHead = tmp->nextSector;
+    yield_write();
+    tmp->nextSector = NULL;
+    yield_write();
+    return tmp;
+}
+
+/** Publishes the items of the "write" sector written in handoff mode. */
+static inline void publishPending(Queue * const queue) {
+    if (!queue->handoffPending) return;
+    yield_write();
+    queue->write->writeCursor += queue->handoffPending;
+    yield_write();
+    queue->handoffPending = 0;
+    if (!queue->read) {
+        yield_write();
+        queue->read = queue->write;
+        yield_write();
+    }
+}
+
+/**
+ * Writes items in handoff mode: they are copied after the write cursor and
+ * the cursor is moved only when the sector is full.
+ * @return the number of items written.
+ */
+static int writeHandoff(Queue * const queue, void * const * const items, int const count) {
+    register int done = 0;
+    while (done < count) {
+        yield_write();
+        register QueueSector * const tmpWrite = queue->write;
+        /* Nothing pending, so the read thread may have drained it all. */
+        if (!queue->handoffPending && queue->read == tmpWrite) {
+            yield_write();
+            if (tmpWrite->writeCursor == tmpWrite->readCursor) {
+                yield_write();
+                tmpWrite->writeCursor = 0;
+                yield_write();
+                tmpWrite->readCursor = 0;
+            }
+        }
+        yield_write();
+        register int const cursor = tmpWrite->writeCursor + queue->handoffPending;
+        register int chunk = tmpWrite->size - cursor;
+        if (chunk > count - done) chunk = count - done;
+        if (chunk > 0) {
+            storeItems(queue, tmpWrite, cursor, items + done, chunk);
+            queue->handoffPending += chunk;
+            if (cursor + chunk == tmpWrite->size) publishPending(queue);
+            if (queue->prefetchDistance)
+                prefetchBeforeRecycle(queue, tmpWrite, cursor + chunk);
+            done += chunk;
+            continue;
+        }
+        register QueueSector * const tmp = takeSpareSector(queue);
+        if (!tmp) {
+            errno = ENOMEM;
+            break;
+        }
+        yield_write();
+        tmp->writeCursor = 0;
+        yield_write();
+        tmp->readCursor = 0;
+        yield_write();
+        tmpWrite->nextSector = tmp;
+        yield_write();
+        queue->write = tmp;
+        yield_write();
+    }
+    return done;
+}
+
+/**
+ * Acknowledges the close, from the read thread, when the queue was found empty
+ * after it was found closed.
+ */
+static inline void acknowledgeClose(Queue * const queue) {
+    yield_read();
+    queue->closeAcknowledged = 1;
+    yield_read();
+}
+
 void * readItem(Queue * const queue) {
-    if (!queue || !queue->read) return NULL;
+    if (!queue) return NULL;
+    /* Closed before we look, so an empty queue stays empty. */
+    register int const closed = queue->closed;
+    yield_read();
+    if (!queue->read) {
+        if (!closed) return NULL;
+        acknowledgeClose(queue);
+        return QUEUE_END;
+    }
     yield_read();
     queue->activeRead = 1;
     yield_read();
@@ -53,10 +299,12 @@ void * readItem(Queue * const queue) {
     while (tmpRead) {
         if (tmpRead->readCursor < tmpRead->writeCursor) {
             yield_read();
-            rez = tmpRead->items[tmpRead->readCursor];
+            rez = loadItem(queue, tmpRead, tmpRead->readCursor);
             yield_read();
             ++tmpRead->readCursor;
             yield_read();
+            if (queue->prefetchDistance)
+                prefetchAfterRead(queue, tmpRead, tmpRead->readCursor);
             break;
         }
         yield_read();
@@ -72,9 +320,74 @@ void * readItem(Queue * const queue) {
     yield_read();
     queue->activeRead = 0;
     yield_read();
+    if (!rez && closed) {
+        acknowledgeClose(queue);
+        return QUEUE_END;
+    }
     return rez;
 }
 
+int readItems(Queue * const queue, void ** const items, int const count) {
+    if (!queue || !items || count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    register int const closed = queue->closed;
+    yield_read();
+    if (!queue->read) {
+        if (!closed) return 0;
+        acknowledgeClose(queue);
+        errno = EPIPE;
+        return -1;
+    }
+    yield_read();
+    queue->activeRead = 1;
+    yield_read();
+    register int got = 0;
+    register QueueSector * tmpRead = queue->read;
+    yield_read();
+    while (tmpRead && got < count) {
+        register int const cursor = tmpRead->readCursor;
+        yield_read();
+        register int const available = tmpRead->writeCursor - cursor;
+        yield_read();
+        if (available > 0) {
+            /* The write thread may have reset an empty sector after we took
+             * the cursor, in that case take it again. */
+            if (tmpRead->readCursor != cursor) continue;
+            yield_read();
+            register int const chunk =
+                available < count - got ? available : count - got;
+            loadItems(queue, tmpRead, cursor, items + got, chunk);
+            yield_read();
+            tmpRead->readCursor = cursor + chunk;
+            yield_read();
+            if (queue->prefetchDistance)
+                prefetchAfterRead(queue, tmpRead, cursor + chunk);
+            got += chunk;
+            continue;
+        }
+        yield_read();
+        if (cursor < tmpRead->size) break;
+        yield_read();
+        if (!tmpRead->nextSector) break;
+        yield_read();
+        queue->read = tmpRead->nextSector;
+        yield_read();
+        tmpRead = queue->read;
+        yield_read();
+    }
+    yield_read();
+    queue->activeRead = 0;
+    yield_read();
+    if (!got && count && closed) {
+        acknowledgeClose(queue);
+        errno = EPIPE;
+        return -1;
+    }
+    return got;
+}
+
 typedef struct StackItem{
     QueueSector const * const item;
     struct StackItem const * const prevItem;
@@ -88,8 +401,22 @@ bool verifyLoop(StackItem const * const si) {
     return verifyLoop(&nsi);
 }
 
+/** Checks that the hot sectors are drained and out of the chain. */
+bool verifyHot(Queue const * const queue) {
+    if (!queue->hotSectors) return true;
+    StackItem const end = {queue->hotSectors, NULL};
+    assert(verifyLoop(&end));
+    for (QueueSector const * hot = queue->hotSectors; hot; hot = hot->nextSector) {
+        assert(hot->readCursor == hot->size && hot->writeCursor == hot->size);
+        for (QueueSector const * qs = queue->writeHead; qs; qs = qs->nextSector)
+            assert(qs != hot);
+    }
+    return true;
+}
+
 bool verify(Queue const * const queue) {
     assert(queue);
+    assert(verifyHot(queue));
     if (!queue->writeHead && !queue->write && !queue->read) return true;
     assert(queue->read || queue->writeHead == queue->write);
     assert(queue->writeHead);
@@ -113,17 +440,22 @@ bool verify(Queue const * const queue) {
 }
 
 int writeItem(Queue * const queue, void * const item) {
-    if (!queue) {
+    if (!queue || !validHandles(queue)) {
         errno = EINVAL;
         return -1;
     }
     yield_write();
-    if (!queue->write) {
-        errno = ENOMEM;
+    if (!queue->write || queue->closed) {
+        errno = queue->closed ? EPIPE : ENOMEM;
+        return -1;
+    }
+    if (!fitHandles(queue, &item, 1)) {
+        errno = EINVAL;
         return -1;
     }
     yield_write();
     assert(verify(queue));
+    if (queue->handoff) return writeHandoff(queue, &item, 1) ? 0 : -1;
     if (queue->read == queue->write) {
         yield_write();
         if (queue->write->writeCursor == queue->write->readCursor) {
@@ -136,10 +468,12 @@ int writeItem(Queue * const queue, void * const item) {
     yield_write();
     if (queue->write->writeCursor < queue->write->size) {
         yield_write();
-        queue->write->items[queue->write->writeCursor] = item;
+        storeItem(queue, queue->write, queue->write->writeCursor, item);
         yield_write();
         ++queue->write->writeCursor;
         yield_write();
+        if (queue->prefetchDistance)
+            prefetchBeforeRecycle(queue, queue->write, queue->write->writeCursor);
         if (!queue->read) {
             yield_write();
             queue->read = queue->write;
@@ -148,22 +482,17 @@ int writeItem(Queue * const queue, void * const item) {
         return 0;
     }
     yield_write();
-    if (queue->writeHead == queue->read || queue->writeHead == queue->write) {
+    register QueueSector * const tmp = takeSpareSector(queue);
+    if (!tmp) {
         errno = ENOMEM;
         return -1;
     }
     yield_write();
-    register QueueSector * const tmp = queue->writeHead;
-    yield_write();
-    queue->writeHead = tmp->nextSector;
-    yield_write();
-    tmp->nextSector = NULL;
-    yield_write();
     tmp->writeCursor = 0;
     yield_write();
     tmp->readCursor = 0;
     yield_write();
-    tmp->items[0] = item;
+    storeItem(queue, tmp, 0, item);
     yield_write();
     tmp->writeCursor = 1;
     yield_write();
@@ -174,6 +503,84 @@ int writeItem(Queue * const queue, void * const item) {
     return 0;
 }
 
+int writeItems(Queue * const queue, void * const * const items, int const count) {
+    if (!queue || (!items && count) || count < 0 || !validHandles(queue)
+            || !fitHandles(queue, items, count)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (queue->handoff) {
+        yield_write();
+        if (!queue->write || queue->closed) {
+            errno = queue->closed ? EPIPE : ENOMEM;
+            return 0;
+        }
+        assert(verify(queue));
+        return writeHandoff(queue, items, count);
+    }
+    register int done = 0;
+    while (done < count) {
+        yield_write();
+        if (!queue->write || queue->closed) {
+            errno = queue->closed ? EPIPE : ENOMEM;
+            break;
+        }
+        yield_write();
+        assert(verify(queue));
+        if (queue->read == queue->write) {
+            yield_write();
+            if (queue->write->writeCursor == queue->write->readCursor) {
+                yield_write();
+                queue->write->writeCursor = 0;
+                yield_write();
+                queue->write->readCursor = 0;
+            }
+        }
+        yield_write();
+        register QueueSector * const tmpWrite = queue->write;
+        register int const cursor = tmpWrite->writeCursor;
+        register int chunk = tmpWrite->size - cursor;
+        if (chunk > count - done) chunk = count - done;
+        if (chunk > 0) {
+            storeItems(queue, tmpWrite, cursor, items + done, chunk);
+            yield_write();
+            tmpWrite->writeCursor = cursor + chunk;
+            yield_write();
+            if (queue->prefetchDistance)
+                prefetchBeforeRecycle(queue, tmpWrite, cursor + chunk);
+            if (!queue->read) {
+                yield_write();
+                queue->read = tmpWrite;
+                yield_write();
+            }
+            done += chunk;
+            continue;
+        }
+        yield_write();
+        register QueueSector * const tmp = takeSpareSector(queue);
+        if (!tmp) {
+            errno = ENOMEM;
+            break;
+        }
+        yield_write();
+        tmp->writeCursor = 0;
+        yield_write();
+        tmp->readCursor = 0;
+        yield_write();
+        chunk = tmp->size < count - done ? tmp->size : count - done;
+        storeItems(queue, tmp, 0, items + done, chunk);
+        yield_write();
+        tmp->writeCursor = chunk;
+        yield_write();
+        queue->write->nextSector = tmp;
+        yield_write();
+        queue->write = tmp;
+        yield_write();
+        done += chunk;
+    }
+    return done;
+}
+
 QueueSector * recoverSector(Queue * const queue) {
     if (!queue) {
         errno = EINVAL;
@@ -181,8 +588,19 @@ QueueSector * recoverSector(Queue * const queue) {
     }
     yield_write();
     assert(verify(queue));
+    if (queue->hotSectors) {
+        register QueueSector * const tmp = queue->hotSectors;
+        yield_write();
+        queue->hotSectors = tmp->nextSector;
+        yield_write();
+        tmp->nextSector = NULL;
+        yield_write();
+        return tmp;
+    }
     if (!queue->writeHead) return NULL;
     yield_write();
+    /* The last sector is not empty while it has items not published. */
+    if (queue->handoffPending && queue->writeHead == queue->write) return NULL;
     if (!queue->read
             || (queue->read == queue->writeHead
                 && queue->writeHead == queue->write
@@ -210,12 +628,80 @@ QueueSector * recoverSector(Queue * const queue) {
     return tmp;
 }
 
+int flushQueue(Queue * const queue) {
+    if (!queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    publishPending(queue);
+    return 0;
+}
+
+int closeQueue(Queue * const queue) {
+    if (!queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    publishPending(queue);
+    yield_write();
+    queue->closed = 1;
+    yield_write();
+    return 0;
+}
+
+QueueSector * releaseSectors(Queue * const queue) {
+    if (!queue || !queue->closed) {
+        errno = EINVAL;
+        return NULL;
+    }
+    yield_write();
+    if (!queue->closeAcknowledged) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    yield_write();
+    assert(verify(queue));
+    /* The chain, then the hot sectors after its end. */
+    register QueueSector * const first = queue->writeHead ? queue->writeHead : queue->hotSectors;
+    if (queue->write) queue->write->nextSector = queue->hotSectors;
+    register int const prefetchDistance = queue->prefetchDistance;
+    register int const recyclePolicy = queue->recyclePolicy;
+    register int const handoff = queue->handoff;
+    register int const streamBatch = queue->streamBatch;
+    *queue = mkHandleQueue(queue->handleBase, queue->handleWidth, queue->handleShift);
+    queue->prefetchDistance = prefetchDistance;
+    queue->recyclePolicy = recyclePolicy;
+    queue->handoff = handoff;
+    queue->streamBatch = streamBatch;
+    return first;
+}
+
+QueueSector * nextReleasedSector(QueueSector const * const sector) {
+    return sector ? sector->nextSector : NULL;
+}
+
+int countSpareSectors(Queue const * const queue) {
+    if (!queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    register QueueSector const * const tmpRead = queue->read;
+    register int count = 0;
+    for (register QueueSector const * qs = queue->writeHead;
+            qs && qs != tmpRead && qs != queue->write; qs = qs->nextSector)
+        ++count;
+    for (register QueueSector const * qs = queue->hotSectors; qs; qs = qs->nextSector)
+        ++count;
+    return count;
+}
+
 int submitSector(Queue * const queue, void * const mem, size_t const size) {
-    if (!mem || !queue) {
+    if (!mem || !queue || !validHandles(queue)) {
         errno = EINVAL;
         return -1;
     }
-    register int const tmpCount = (size - 3 * sizeof(int) - 2 * sizeof(void*)) / sizeof(void*);
+    register int const tmpCount = size < 3 * sizeof(int) + 2 * sizeof(void*) ? 0
+        : (size - 3 * sizeof(int) - 2 * sizeof(void*)) / itemWidth(queue);
     if (tmpCount <= 0) {
         errno = ENOMEM;
         return -1;
@@ -69,21 +69,161 @@ typedef struct Queue {
      * and reset to 0 by the reader after finishing work on the read QueueSector.
      */
     int volatile activeRead;
+    /**
+     * How many items ahead to prefetch, 0 for no prefetching.
+     * The read thread prefetches the item it will read that many items later,
+     * or the next sector if that is past the end of the current one.
+     * The write thread prefetches, for writing, the spare sector it will
+     * recycle once it gets that close to the end of the "write" sector.
+     * This member is set before the queue is used by the threads.
+     */
+    int prefetchDistance;
+    /**
+     * Which spare sector the write thread recycles, one of RecyclePolicy.
+     * This member is set before the queue is used by the threads.
+     */
+    int recyclePolicy;
+    /**
+     * The spare sectors taken out of the chain by recycleLifo, the last
+     * drained on top, linked by their nextSector.
+     * This member is handled only by the write thread.
+     */
+    struct QueueSector * hotSectors;
+    /**
+     * Set to 1 by 'closeQueue', nothing is written after it.
+     * This member is written only by the write thread.
+     */
+    int volatile closed;
+    /**
+     * Set to 1 by the read thread when it found the queue closed and empty,
+     * it does not touch the sectors after that.
+     * This member is written only by the read thread.
+     */
+    int volatile closeAcknowledged;
+    /**
+     * 1 to hand the items over a sector at a time.
+     * The write thread fills the "write" sector without moving its write
+     * cursor and publishes the whole sector with one store once it is full,
+     * or when 'flushQueue' is called. The read thread sees the items in
+     * chunks as large as a sector, for the least traffic between the caches,
+     * but an item can wait until the next flush.
+     * This member is set before the queue is used by the threads.
+     */
+    int handoff;
+    /**
+     * The items written into the "write" sector after its write cursor, not
+     * published yet.
+     * This member is handled only by the write thread.
+     */
+    int handoffPending;
+    /**
+     * The size in bytes of an item in the sectors: 0 for a pointer, 4 or 2
+     * for a handle, the offset of the item from "handleBase" shifted right
+     * by "handleShift". Smaller handles put more items in a cache line and
+     * in a sector of the same size.
+     * These members are set before any sector is submitted, see
+     * 'mkHandleQueue'.
+     */
+    int handleWidth;
+    int handleShift;
+    char * handleBase;
+    /**
+     * From how many items a chunk is written into a sector with non temporal
+     * stores, bypassing the cache of the write thread, 0 for never.
+     * For very large batches whose items the write thread will not touch
+     * again, see 'streamItems'.
+     * This member is set before the queue is used by the threads.
+     */
+    int streamBatch;
 } Queue;
 
+/**
+ * What 'readItem' returns once the queue is closed and all the items were
+ * read.
+ */
+#define QUEUE_END ((void *)-1)
+
+/** How the write thread picks the spare sector it recycles. */
+typedef enum RecyclePolicy {
+    /**
+     * The one at "writeHead", the one drained first, so every sector in turn.
+     */
+    recycleFifo,
+    /**
+     * The one drained last, the one still in the cache.
+     * When recycling, the write thread moves the spare sectors, from
+     * "writeHead" up to "read", onto "hotSectors" and takes the top one.
+     * With a short backlog the queue keeps using the same few sectors
+     * and the others stay cold.
+     */
+    recycleLifo
+} RecyclePolicy;
+
+/**
+ * The size in bytes of a memory chunk that 'submitSector' turns into a sector
+ * holding exactly count items.
+ */
+#define QUEUE_SECTOR_SIZE(count) \
+    (3 * sizeof(int) + 2 * sizeof(void*) + (count) * sizeof(void*))
+
+/**
+ * The size in bytes of a memory chunk that 'submitSector' turns into a sector
+ * holding exactly count handles of width bytes.
+ */
+#define QUEUE_HANDLE_SECTOR_SIZE(count, width) \
+    (3 * sizeof(int) + 2 * sizeof(void*) + (count) * (size_t)(width))
+
 /** Creates of an empty queue. */
 static inline Queue mkQueue() {
-    Queue const tmp = {NULL, NULL, NULL, 0};
+    Queue const tmp = {NULL, NULL, NULL, 0, 0, recycleFifo, NULL, 0, 0, 0, 0, 0, 0, NULL, 0};
+    return tmp;
+}
+
+/**
+ * Creates an empty queue that keeps handles instead of pointers.
+ * Every item written must be base plus a multiple of 1 << shift, up to
+ * 2^(8 * width) of them; the read thread gets back the same pointer.
+ * With a NULL base and a shift of 0 the items are small numbers.
+ * @param base the start of the arena holding the items.
+ * @param width the size of a handle, 4 or 2.
+ * @param shift the log2 of the alignment of the items in the arena.
+ * With another width, or a shift not under the bits of a pointer,
+ * 'submitSector' and the writes fail with EINVAL.
+ */
+static inline Queue mkHandleQueue(void * const base, int const width, int const shift) {
+    Queue tmp = mkQueue();
+    tmp.handleWidth = width;
+    tmp.handleShift = shift;
+    tmp.handleBase = (char *)base;
     return tmp;
 }
 
 /**
  * Reads next item from the queue.
  * If the queue is empty it will return NULL.
+ * If the queue is closed and empty it will return QUEUE_END, from then on the
+ * read thread must not touch the queue: the write thread may take the sectors
+ * back and reuse it. A wrapper that reads the queue more then once keeps the
+ * end in its own state and answers from there.
  * @param queue the queue that you want to get an item from.
  */
 void * readItem(Queue * const queue);
 
+/**
+ * Reads up to count items from the queue into the items array.
+ * The read cursor of a sector is advanced once for all the items taken from
+ * it, not once per item, and large chunks are copied with the vector kernel
+ * of 'copyItems'.
+ * If the queue is empty it will return 0.
+ * @param queue the queue that you want to get the items from.
+ * @param items the array that receives the items.
+ * @param count the maximum number of items to read.
+ * @return the number of items read, -1 on invalid arguments (EINVAL) or, once
+ * the queue is closed and all the items were read, -1 with EPIPE; after that
+ * the read thread must not touch the queue, as after QUEUE_END.
+ */
+int readItems(Queue * const queue, void ** const items, int const count);
+
 /**
  * Writes an item into the queue, if there is space.
  * If there is no space in the "write" sector it will try to recycle a sector
@@ -96,15 +236,44 @@ void * readItem(Queue * const queue);
  * even with only one sector inside. But you should submit at least 2 sectors.
  * @param queue the queue to which to add a sector.
  * @param item the item that you want to add to the queue.
- * @return On success 0, -1 otherwise.
+ * @return On success 0, -1 otherwise (ENOMEM, EPIPE if the queue is closed,
+ * EINVAL if the item does not fit a handle).
  */
 int writeItem(Queue * const queue, void * const item);
 
+/**
+ * Writes up to count items into the queue, in order.
+ * The items are copied into the "write" sector first and the write cursor is
+ * published once per sector, so the read thread sees them in chunks.
+ * Large chunks are copied with the vector kernel of 'copyItems', or
+ * 'streamItems' from "streamBatch" items on.
+ * Sectors are recycled from "writeHead" the same way as in 'writeItem'.
+ *
+ * If the queue gets full only a part of the items is written and errno is set
+ * to ENOMEM.
+ * @param queue the queue to which to add the items.
+ * @param items the items that you want to add to the queue.
+ * @param count the number of items.
+ * @return the number of items written, -1 on invalid arguments (EINVAL, also
+ * when an item does not fit a handle, then nothing is written).
+ */
+int writeItems(Queue * const queue, void * const * const items, int const count);
+
+/**
+ * Publishes the items written but not published yet in handoff mode.
+ * Call it from the write thread, often enough to bound the latency, for
+ * example when it has nothing more to write or on a timer.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int flushQueue(Queue * const queue);
+
 /**
  * Submits a memory chunk that will become a 'QueueSector'.
  * The sector will be put at the head of the queue.
  *
  * If the memory chunk is to small you will get an error with ENOMEM.
+ * The sector holds as many items as fit, pointers or handles as the queue
+ * keeps them.
  * @param queue the queue to which to add a sector.
  * @param meme the pointer to the chunk of the memory to be used.
  * @param size the size in bytes of the memory chunk.
@@ -118,6 +287,7 @@ int submitSector(Queue * const queue, void * const mem, size_t const size);
  * In normal operation is easy to pop an unused sector. If there are more
  * sectors then one in total and if there is at least one sector free then
  * for sure queue->writeHead is one of them, we will just pop it out.
+ * A sector on queue->hotSectors is taken before that.
  *
  * When there is only one sector in the queue and is empty:
  *      - we set queue->read to NULL, to block the read thread to access the sector.
@@ -129,4 +299,41 @@ int submitSector(Queue * const queue, void * const mem, size_t const size);
  */
 struct QueueSector * recoverSector(Queue * const queue);
 
+/**
+ * Closes the queue, from the write thread, after the last item.
+ * The items not published yet in handoff mode are published first.
+ * The read thread reads the items left and then gets QUEUE_END, which it
+ * acknowledges by not touching the queue any more.
+ * @param queue the queue.
+ * @return On success 0, -1 otherwise (EINVAL).
+ */
+int closeQueue(Queue * const queue);
+
+/**
+ * Takes all the sectors out of a closed queue, from the write thread, once
+ * the read thread acknowledged the close.
+ * The queue is empty and open again after it, as made by 'mkQueue' but with
+ * the same prefetchDistance, recyclePolicy, handoff, handles and streamBatch.
+ * @param queue the queue.
+ * @return the first sector, walk the others with 'nextReleasedSector'; NULL
+ * if there were no sectors or on failure (EINVAL if the queue is not closed,
+ * EAGAIN if the read thread did not acknowledge yet).
+ */
+struct QueueSector * releaseSectors(Queue * const queue);
+
+/**
+ * @return the sector after a sector returned by 'releaseSectors', NULL after
+ * the last one. Take it before reusing the memory of the sector.
+ */
+struct QueueSector * nextReleasedSector(struct QueueSector const * const sector);
+
+/**
+ * Counts the spare sectors, the ones from "writeHead" up to "read" and the
+ * "hotSectors", that 'writeItem' can recycle and 'recoverSector' can take out.
+ * It walks the spare sectors, so it has to be called by the write thread.
+ * @param queue the queue.
+ * @return the number of spare sectors, -1 on invalid arguments (EINVAL).
+ */
+int countSpareSectors(Queue const * const queue);
+
 #endif
@@ -0,0 +1,128 @@
+#define _GNU_SOURCE
+#include "ItemCopy.h"
+#include "TransThread.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+
+/*
+The benchmark.
+A write thread sends "items" numbers to a read thread through one queue and we
+measure the time per item.
+
+./bench [items] [sectors] [itemsPerSector] [prefetchDistance] [batch] [lifo] [handoff] [handles]
+        [stream] [kernel]
+
+With a batch of 1 the threads use 'writeItem' and 'readItem', otherwise
+'writeItems' and 'readItems'. With lifo 1 the spare sectors are recycled
+last drained first. With handoff 1 the items are published a sector at a
+time, flushed when the write thread has to wait. With handles 1 the sectors
+keep 32 bit handles, twice the items in the same memory. Chunks of stream
+items or more are written with non temporal stores. The kernel of the large
+copies is the widest the CPU has, or 1 scalar, 2 SSE2, 3 AVX2.
+The write thread is pinned on CPU 0 and the read thread on the last CPU.
+*/
+
+static long int items = 20000000;
+static int sectors = 16;
+static int itemsPerSector = 1024;
+static int batch = 1;
+static Queue queue;
+
+static void pin(int const cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+static void * reader(void * arg) {
+    pin(sysconf(_SC_NPROCESSORS_ONLN) - 1);
+    void ** const buffer = malloc(sizeof(void*) * batch);
+    long int expect = 1;
+    while (expect <= items) {
+        if (batch == 1) {
+            long int const got = (long int)readItem(&queue);
+            if (!got) {
+                sched_yield();
+                continue;
+            }
+            assert(got == expect);
+            ++expect;
+            continue;
+        }
+        int const count = readItems(&queue, buffer, batch);
+        if (!count) sched_yield();
+        for (int i = 0; i < count; ++i, ++expect)
+            assert((long int)buffer[i] == expect);
+    }
+    free(buffer);
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    if (argc > 1) items = atol(argv[1]);
+    if (argc > 2) sectors = atoi(argv[2]);
+    if (argc > 3) itemsPerSector = atoi(argv[3]);
+    queue = argc > 8 && atoi(argv[8]) ? mkHandleQueue(NULL, 4, 0) : mkQueue();
+    if (argc > 4) queue.prefetchDistance = atoi(argv[4]);
+    if (argc > 5) batch = atoi(argv[5]);
+    if (batch < 1) batch = 1;
+    if (argc > 6 && atoi(argv[6])) queue.recyclePolicy = recycleLifo;
+    if (argc > 7) queue.handoff = atoi(argv[7]) != 0;
+    if (argc > 9) queue.streamBatch = atoi(argv[9]);
+    if (argc > 10 && itemCopyUse(atoi(argv[10]))) {
+        perror("kernel");
+        return 1;
+    }
+    for (int i = 0; i < sectors; ++i) {
+        size_t const size = queue.handleWidth
+            ? QUEUE_HANDLE_SECTOR_SIZE(itemsPerSector, queue.handleWidth)
+            : QUEUE_SECTOR_SIZE(itemsPerSector);
+        int const submitted = submitSector(&queue, malloc(size), size);
+        assert(0 == submitted);
+        (void)submitted;
+    }
+    void ** const buffer = malloc(sizeof(void*) * batch);
+    pin(0);
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    pthread_t thread;
+    int const created = pthread_create(&thread, NULL, reader, NULL);
+    assert(0 == created);
+    (void)created;
+    for (long int value = 1; value <= items;) {
+        if (batch == 1) {
+            if (!writeItem(&queue, (void*)value)) ++value;
+            else {
+                flushQueue(&queue);
+                sched_yield();
+            }
+            continue;
+        }
+        int count = 0;
+        for (; count < batch && value + count <= items; ++count)
+            buffer[count] = (void*)(value + count);
+        int const written = writeItems(&queue, buffer, count);
+        if (!written) {
+            flushQueue(&queue);
+            sched_yield();
+        }
+        value += written;
+    }
+    flushQueue(&queue);
+    pthread_join(thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double const ns = (end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec);
+    printf("items %ld sectors %d x %d prefetch %d batch %d %s%s%s stream %d %s: %.2f ns/item\n",
+            items, sectors, itemsPerSector, queue.prefetchDistance, batch,
+            queue.recyclePolicy == recycleLifo ? "lifo" : "fifo",
+            queue.handoff ? " handoff" : "", queue.handleWidth ? " handles" : "",
+            queue.streamBatch, itemCopyName(), ns / items);
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "OpTrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+The sizing simulator.
+It replays a trace written by 'opTraceDump' against queues of other shapes and
+tells, for every shape, how the queue would have done.
+
+./simQueue trace [sectors x itemsPerSector]...
+
+For example "./simQueue run.trace 4x256 16x1024".
+
+The write thread of the trace offers its items at the times it wrote them; the
+ones that do not fit wait and are tried again at its next operation. The read
+thread takes, at the times it read, as many items as it did then, at least
+one. Everything runs on the real queue, in one thread, in the order of the
+trace.
+*/
+
+typedef struct Result {
+    unsigned long attempts;
+    unsigned long enomem;
+    unsigned long peak;
+    unsigned long delivered;
+    unsigned long undelivered;
+    double totalDelay;
+    uint64_t maxDelay;
+} Result;
+
+static Queue queue;
+static uint64_t * written;
+static unsigned long sequence;
+static unsigned long backlog;
+
+static void flush(uint64_t const ns, Result * const result) {
+    while (backlog) {
+        ++result->attempts;
+        if (writeItem(&queue, (void *)(sequence + 1))) {
+            ++result->enomem;
+            return;
+        }
+        written[sequence++] = ns;
+        --backlog;
+    }
+}
+
+static void simulate(OpTrace const * const trace, uint64_t const items,
+        int const sectors, int const itemsPerSector, Result * const result) {
+    size_t const size = QUEUE_SECTOR_SIZE(itemsPerSector);
+    char * const memory = malloc(size * sectors);
+    queue = mkQueue();
+    for (int s = 0; s < sectors; ++s) submitSector(&queue, memory + size * s, size);
+    sequence = backlog = 0;
+    Result const empty = {0};
+    *result = empty;
+    for (uint64_t e = 0; e < trace->count; ++e) {
+        OpEvent const * const event = &trace->events[e];
+        if (event->role == opWriter) {
+            if (event->op == opWrite) backlog += event->count;
+            flush(event->ns, result);
+            if (sequence - result->delivered > result->peak)
+                result->peak = sequence - result->delivered;
+            continue;
+        }
+        if (event->op != opRead && event->op != opEmpty) continue;
+        for (uint32_t i = 0; i < event->count || !i; ++i) {
+            void * const item = readItem(&queue);
+            if (!item) break;
+            uint64_t const delay = event->ns - written[(unsigned long)item - 1];
+            result->totalDelay += delay;
+            if (delay > result->maxDelay) result->maxDelay = delay;
+            ++result->delivered;
+        }
+    }
+    result->undelivered = items - result->delivered;
+    free(memory);
+}
+
+int main (int argc, char * argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace [sectors x itemsPerSector]...\n", argv[0]);
+        return 1;
+    }
+    OpTrace * const trace = opTraceLoad(argv[1]);
+    if (!trace) {
+        perror(argv[1]);
+        return 1;
+    }
+    uint64_t items = 0, full = 0, reads = 0, empties = 0;
+    for (uint64_t e = 0; e < trace->count; ++e) {
+        OpEvent const * const event = &trace->events[e];
+        if (event->op == opWrite) items += event->count;
+        if (event->op == opFull) ++full;
+        if (event->op == opRead) ++reads;
+        if (event->op == opEmpty) ++empties;
+    }
+    written = malloc(sizeof(uint64_t) * (items ? items : 1));
+    double const span = trace->count
+        ? (trace->events[trace->count - 1].ns - trace->events[0].ns) / 1e9 : 0;
+    printf("trace: %lu operations over %.3fs, %lu items written, %lu full writes, "
+            "%lu reads, %lu empty reads\n", (unsigned long)trace->count, span,
+            (unsigned long)items, (unsigned long)full, (unsigned long)reads,
+            (unsigned long)empties);
+    printf("%8s %8s %12s %10s %10s %12s %12s %12s\n", "sectors", "items",
+            "bytes", "enomem%", "peak", "meanDelayNs", "maxDelayNs", "undelivered");
+    static char const * const defaults[] = {"2x64", "4x256", "16x1024"};
+    int const configs = argc > 2 ? argc - 2 : 3;
+    for (int c = 0; c < configs; ++c) {
+        char const * const config = argc > 2 ? argv[c + 2] : defaults[c];
+        int sectors, itemsPerSector;
+        if (sscanf(config, "%dx%d", &sectors, &itemsPerSector) != 2
+                || sectors < 1 || itemsPerSector < 1) {
+            fprintf(stderr, "bad configuration %s\n", config);
+            continue;
+        }
+        Result result;
+        simulate(trace, items, sectors, itemsPerSector, &result);
+        printf("%8d %8d %12lu %10.3f %10lu %12.0f %12lu %12lu\n", sectors,
+                itemsPerSector, (unsigned long)(QUEUE_SECTOR_SIZE(itemsPerSector) * sectors),
+                result.attempts ? 100.0 * result.enomem / result.attempts : 0.0,
+                result.peak, result.delivered ? result.totalDelay / result.delivered : 0.0,
+                (unsigned long)result.maxDelay, result.undelivered);
+    }
+    free(written);
+    destroyOpTrace(trace);
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <assert.h>
+#include <errno.h>
 
 coro_context writeTask, readTask;
 struct coro_stack stack;
@@ -19,18 +20,37 @@ void yield_write() {
         coro_transfer(&writeTask, &readTask);
 }
 
-Queue queue = {NULL, NULL, NULL, 0};
+Queue queue = {NULL, NULL, NULL, 0, 0, recycleFifo, NULL, 0, 0, 0, 0, 0, 0, NULL, 0};
 
 void coro_readTask(void *arg) {
     int currentExpect = 1;
     int got = 0;
+    void * batch[16];
     do {
         got = 0;
-        while (!(got = (long long int) readItem(&queue)))
-            yield_read();
-        assert (got == currentExpect);
-        ++currentExpect;
+        if (rand() & 16) {
+            void * item;
+            while (!(item = readItem(&queue)))
+                yield_read();
+            if (item == QUEUE_END) break;
+            got = (long long int) item;
+            assert (got == currentExpect);
+            ++currentExpect;
+        } else {
+            int const count = readItems(&queue, batch, 1 + rand() % 16);
+            if (count < 0 && errno == EPIPE) break;
+            assert (count >= 0);
+            if (!count) yield_read();
+            for (int i = 0; i < count; ++i) {
+                got = (long long int) batch[i];
+                assert (got == currentExpect);
+                ++currentExpect;
+            }
+        }
     } while (got != theLimit);
+    /* The queue was closed, all must have come and we must not touch it. */
+    assert (currentExpect == theLimit);
+    for (;;) yield_read();
 }
 
 typedef enum WriteCommand {
@@ -39,6 +59,8 @@ typedef enum WriteCommand {
     sendItem,
     sendItem1,
     sendItem2,
+    sendBatch,
+    flushItems,
     lastCommand
 } WriteCommand;
 
@@ -64,8 +86,29 @@ int main (int argc, char * argv[]) {
     srand(seed);
     printf("The seed used:%d\n", seed);
     fflush(stdout);
-    /* we have up to 100 sectors */
-    int sectorNum = 1 + rand() % 100;
+    /* a width a handle cannot have is refused before anything is written */
+    {
+        Queue odd = mkHandleQueue(NULL, 3, 0);
+        void * one = (void*)1;
+        int const submitted = submitSector(&odd, &one, sizeof(one));
+        assert (-1 == submitted && errno == EINVAL);
+        int const written = writeItems(&odd, &one, 1);
+        assert (-1 == written && errno == EINVAL);
+    }
+    /* sometimes keeping the items as 32 bit handles, they are small numbers */
+    if (rand() % 2) queue = mkHandleQueue(NULL, 4, 0);
+    /* sometimes with prefetching, it must not change anything */
+    queue.prefetchDistance = rand() % 2 * rand() % 16;
+    /* and either recycling policy, the order of the items must not change */
+    queue.recyclePolicy = rand() % 2 ? recycleLifo : recycleFifo;
+    /* and sometimes handing over whole sectors, flushed now and then */
+    queue.handoff = rand() % 2;
+    /* and sometimes streaming the larger chunks past the cache */
+    queue.streamBatch = rand() % 2 * rand() % 16;
+    /* at the end either reclaim the sectors one by one or close the queue */
+    int const closing = rand() % 2;
+    /* we have up to 100 sectors, at least one of them submitted */
+    int sectorNum = 2 + rand() % 99;
     int sectorStack = sectorNum - 1;
     int proc = -1;
     void **sectorPool = alloca(sizeof (void*) * sectorNum);
@@ -86,7 +129,28 @@ int main (int argc, char * argv[]) {
         }
         int nd = rand();
         WriteCommand command = nd % lastCommand;
-        if (currentWrite == theLimit) command = reclaimSector;
+        if (currentWrite == theLimit) {
+            int const flushed = flushQueue(&queue);
+            assert (0 == flushed);
+            command = reclaimSector;
+        }
+        if (currentWrite == theLimit && closing) {
+            if (!queue.closed) {
+                int const closed = closeQueue(&queue);
+                assert (0 == closed);
+            }
+            int const late = writeItem(&queue, (void*)1);
+            assert (-1 == late && errno == EPIPE);
+            struct QueueSector * sector = releaseSectors(&queue);
+            if (!sector) {
+                assert (errno == EAGAIN);
+                coro_transfer(&writeTask, &readTask);
+                continue;
+            }
+            for (; sector; sector = nextReleasedSector(sector)) ++sectorStack;
+            assert (!queue.write && !queue.closed);
+            break;
+        }
         switch(command) {
         case allocateSector:
             if (sectorStack > 0) {
@@ -120,8 +184,27 @@ int main (int argc, char * argv[]) {
                 ++currentWrite;
             }
             break;
+        case sendBatch:
+            {
+                void * batch[16];
+                int count = 1 + rand() % 16;
+                if (count > theLimit - currentWrite) count = theLimit - currentWrite;
+                for (int i = 0; i < count; ++i)
+                    batch[i] = (void*)(long int)(currentWrite + i);
+                int const written = writeItems(&queue, batch, count);
+                assert (written >= 0 && written <= count);
+                currentWrite += written;
+            }
+            break;
+        case flushItems:
+            {
+                int const flushed = flushQueue(&queue);
+                assert (0 == flushed && !queue.handoffPending);
+            }
+            break;
         }
         yield_write();
     } while (currentWrite < theLimit || queue.write);
+    assert (!queue.hotSectors && sectorStack == sectorNum - 1);
     return 0;
 }
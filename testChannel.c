@@ -0,0 +1,158 @@
+#include "BufferChannel.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+We test like this.
+First one thread takes all the buffers, sends, receives and releases them and
+checks they come back to the pool only in batches.
+Then a write thread fills buffers with the numbers from 1 up to "theLimit"
+while the main thread checks and releases them, until the channel is closed.
+All the buffers must come from the channel and the write thread must never
+find the queues full.
+*/
+
+#define buffers 64
+#define theLimit 500000
+
+static BufferChannel * channel;
+
+static void * writer(void * arg) {
+    void * batch[4];
+    for (long int value = 1; value <= theLimit;) {
+        int count = 0;
+        while (count < 4 && value + count <= theLimit) {
+            long int * const buffer = channelAlloc(channel);
+            if (!buffer) break;
+            buffer[0] = value + count;
+            memset(buffer + 1, (char)(value + count), channelBufferSize(channel) - sizeof(long int));
+            batch[count++] = buffer;
+        }
+        if (!count) {
+            sched_yield();
+            continue;
+        }
+        int const sent = channelSendItems(channel, batch, count);
+        assert(count == sent);
+        value += count;
+    }
+    int const closed = channelClose(channel);
+    assert(0 == closed);
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    void * taken[8];
+    void * item;
+    int result;
+
+    channel = createBufferChannel(8, 100, 4, 4);
+    assert(channel);
+    assert(channelBufferSize(channel) == 128);
+    for (int i = 0; i < 8; ++i) {
+        taken[i] = channelAlloc(channel);
+        assert(taken[i]);
+        for (int j = 0; j < i; ++j) assert(taken[i] != taken[j]);
+    }
+    item = channelAlloc(channel);
+    assert(NULL == item);
+    result = channelFree(channel, taken[7]);
+    assert(0 == result);
+    item = channelAlloc(channel);
+    assert(taken[7] == item);
+    /* Not a buffer of the channel, or not the start of one. */
+    long int stranger;
+    result = channelSend(channel, &stranger);
+    assert(-1 == result && errno == EINVAL);
+    result = channelSend(channel, (char *)taken[0] + 1);
+    assert(-1 == result && errno == EINVAL);
+    result = channelFree(channel, &stranger);
+    assert(-1 == result && errno == EINVAL);
+    result = channelSendItems(channel, (void * const *)taken, -1);
+    assert(-1 == result && errno == EINVAL);
+    item = channelAlloc(NULL);
+    assert(NULL == item && errno == EINVAL);
+    item = channelReceive(NULL);
+    assert(NULL == item && errno == EINVAL);
+    result = channelRelease(NULL, taken[0]);
+    assert(-1 == result && errno == EINVAL);
+    result = channelFlushReturns(NULL);
+    assert(-1 == result && errno == EINVAL);
+    result = 0;
+    for (int i = 0; i < 8; ++i) result |= channelSend(channel, taken[i]);
+    assert(0 == result);
+    for (int i = 0; i < 3; ++i) {
+        item = channelReceive(channel);
+        assert(taken[i] == item);
+        channelRelease(channel, taken[i]);
+    }
+    item = channelAlloc(channel);
+    assert(NULL == item);
+    item = channelReceive(channel);
+    assert(taken[3] == item);
+    channelRelease(channel, taken[3]);
+    item = channelAlloc(channel);
+    assert(item);
+    result = channelReceiveItems(channel, taken, 8);
+    assert(4 == result);
+    channelRelease(channel, taken[0]);
+    result = channelFlushReturns(channel);
+    assert(1 == result);
+    for (int i = 0; i < 3; ++i) {
+        item = channelAlloc(channel);
+        assert(item);
+    }
+    item = channelAlloc(channel);
+    assert(taken[0] == item);
+    item = channelAlloc(channel);
+    assert(NULL == item);
+    result = channelSend(channel, taken[0]);
+    assert(0 == result);
+    result = channelClose(channel);
+    assert(0 == result);
+    result = channelSend(channel, taken[1]);
+    assert(-1 == result && errno == EPIPE);
+    item = channelReceive(channel);
+    assert(taken[0] == item);
+    item = channelReceive(channel);
+    assert(QUEUE_END == item);
+    result = channelReceiveItems(channel, taken, 8);
+    assert(-1 == result && errno == EPIPE);
+    destroyBufferChannel(channel);
+
+    channel = createBufferChannel(buffers, 256, 16, 8);
+    assert(channel);
+    pthread_t thread;
+    result = pthread_create(&thread, NULL, writer, NULL);
+    assert(0 == result);
+    void * items[16];
+    long int expect = 1;
+    for (;;) {
+        int const count = channelReceiveItems(channel, items, 16);
+        if (count < 0) {
+            assert(errno == EPIPE);
+            break;
+        }
+        if (!count) {
+            channelFlushReturns(channel);
+            sched_yield();
+        }
+        for (int i = 0; i < count; ++i) {
+            long int * const buffer = items[i];
+            assert(buffer[0] == expect);
+            assert(((char *)buffer)[255] == (char)expect);
+            ++expect;
+            channelRelease(channel, buffer);
+        }
+    }
+    assert(expect == theLimit + 1);
+    pthread_join(thread, NULL);
+    destroyBufferChannel(channel);
+    printf("buffer channel ok\n");
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "ConflatingQueue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+First one thread checks that a key written twice is read once, with its
+newest value, and the limits on the keys and on the values.
+Then a write thread writes "theLimit" rounds of increasing values to every key
+while the main thread reads them, checking that the values of a key only grow
+and that the last value of every key arrives.
+*/
+
+#define keyCount 100
+#define theLimit 20000
+
+static ConflatingQueue * queue;
+
+static void * writer(void * arg) {
+    for (long int round = 1; round <= theLimit; ++round)
+        for (uint64_t key = 0; key < keyCount; ++key)
+            while (conflateWrite(queue, key * 7919, (void*)round) < 0) sched_yield();
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    uint64_t key;
+    void * value;
+
+    queue = createConflatingQueue(2, 2, 8);
+    assert(queue);
+    value = conflateRead(queue, &key);
+    assert(NULL == value);
+    int const first = conflateWrite(queue, 5, (void*)1);
+    int const second = conflateWrite(queue, 9, (void*)2);
+    int const again = conflateWrite(queue, 5, (void*)3);
+    int const tooMany = conflateWrite(queue, 11, (void*)4);
+    int const none = conflateWrite(queue, 9, NULL);
+    assert(0 == first && 0 == second && 1 == again && -1 == tooMany && -1 == none);
+    value = conflateRead(queue, &key);
+    assert((void*)3 == value && key == 5);
+    int const back = conflateWrite(queue, 5, (void*)5);
+    assert(0 == back);
+    value = conflateRead(queue, &key);
+    assert((void*)2 == value && key == 9);
+    value = conflateRead(queue, &key);
+    assert((void*)5 == value && key == 5);
+    value = conflateRead(queue, &key);
+    assert(NULL == value);
+    assert(1 == conflatedCount(queue));
+    destroyConflatingQueue(queue);
+
+    queue = createConflatingQueue(keyCount, 4, 16);
+    assert(queue);
+    pthread_t thread;
+    int const created = pthread_create(&thread, NULL, writer, NULL);
+    assert(0 == created);
+    static long int last[keyCount];
+    long int reads = 0;
+    for (int done = 0; done < keyCount;) {
+        value = conflateRead(queue, &key);
+        if (!value) {
+            sched_yield();
+            continue;
+        }
+        assert(key % 7919 == 0 && key / 7919 < keyCount);
+        assert((long int)value > last[key / 7919]);
+        last[key / 7919] = (long int)value;
+        if ((long int)value == theLimit) ++done;
+        ++reads;
+    }
+    pthread_join(thread, NULL);
+    value = conflateRead(queue, &key);
+    assert(NULL == value);
+    assert(reads + conflatedCount(queue) == (long int)keyCount * theLimit);
+    printf("conflating queue ok: %ld reads for %ld writes\n", reads, (long int)keyCount * theLimit);
+    destroyConflatingQueue(queue);
+    return 0;
+}
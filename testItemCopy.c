@@ -0,0 +1,53 @@
+#include "ItemCopy.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+We test like this.
+With every kernel the CPU has, plain and streaming, we copy every count from 0
+up to a few hundred items, from every alignment to every alignment, between
+arrays guarded by a few items on each side, and check the copy and the guards.
+*/
+
+#define maxCount 300
+#define guard 8
+
+static void * src[maxCount + 2 * guard];
+static void * dst[maxCount + 2 * guard];
+
+static void check(int const streaming) {
+    for (int count = 0; count <= maxCount; count += count < 40 ? 1 : 37)
+        for (int from = 0; from < 4; ++from)
+            for (int to = 0; to < 4; ++to) {
+                for (int i = 0; i < maxCount + 2 * guard; ++i) dst[i] = NULL;
+                if (streaming) streamItems(dst + guard + to, src + guard + from, count);
+                else copyItems(dst + guard + to, src + guard + from, count);
+                for (int i = 0; i < maxCount + 2 * guard; ++i) {
+                    int const inside = i >= guard + to && i < guard + to + count;
+                    assert(dst[i] == (inside ? src[i - to + from] : NULL));
+                }
+            }
+}
+
+int main (int argc, char * argv[]) {
+    for (long int i = 0; i < maxCount + 2 * guard; ++i) src[i] = (void*)(i * 7 + 1);
+    int const unknown = itemCopyUse(9);
+    assert(-1 == unknown && errno == EINVAL);
+    for (CopyKernel kernel = copyAuto; kernel <= copyAvx2; ++kernel) {
+        if (itemCopyUse(kernel)) {
+            assert(errno == ENOTSUP);
+            printf("no %d kernel\n", kernel);
+            continue;
+        }
+        check(0);
+        check(1);
+        printf("%s ok\n", itemCopyName());
+    }
+    int const scalar = itemCopyUse(copyScalar);
+    assert(0 == scalar && !strcmp(itemCopyName(), "scalar"));
+    printf("item copy ok\n");
+    return 0;
+}
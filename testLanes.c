@@ -0,0 +1,108 @@
+#include "PriorityLanes.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+First one thread fills the lanes and checks the order of readPriority: strict
+priority without weights, then one lower item after every "weight" items.
+Then a write thread sends the numbers from 1 up to "theLimit" to random lanes
+while the main thread reads them and checks that every lane keeps its order,
+up to the end of the closed bundle.
+*/
+
+#define lanes 3
+#define theLimit 1000000
+
+static PriorityLanes * bundle;
+
+static void * writer(void * arg) {
+    static long int sent[lanes];
+    for (long int i = 1; i <= theLimit; ++i) {
+        int const lane = rand() % 8 ? 0 : 1 + rand() % (lanes - 1);
+        long int const value = ++sent[lane];
+        while (writePriority(bundle, (void*)value, lane)) sched_yield();
+    }
+    int const closed = closePriorityLanes(bundle);
+    assert(0 == closed);
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    int lane;
+    void * item;
+    int failed = 0;
+
+    bundle = createPriorityLanes(lanes, 4, 32);
+    assert(bundle);
+    item = readPriority(bundle, &lane);
+    assert(NULL == item);
+    for (long int i = 1; i <= 4; ++i) {
+        failed |= writePriority(bundle, (void*)i, 0);
+        failed |= writePriority(bundle, (void*)(10 + i), 2);
+    }
+    assert(!failed);
+    for (long int i = 1; i <= 4; ++i) {
+        item = readPriority(bundle, &lane);
+        assert((void*)(10 + i) == item && lane == 2);
+    }
+    item = readPriority(bundle, &lane);
+    assert((void*)1 == item && lane == 0);
+    failed = writePriority(bundle, (void*)1, lanes);
+    assert(-1 == failed && errno == EINVAL);
+    failed = writePriority(bundle, NULL, 0);
+    assert(-1 == failed && errno == EINVAL);
+
+    failed = priorityLaneWeight(bundle, 2, 2);
+    for (long int i = 1; i <= 6; ++i) failed |= writePriority(bundle, (void*)(10 + i), 2);
+    assert(!failed);
+    /* Two from the high lane, one from the low one, and so on. */
+    long int const expect[] = {11, 12, 2, 13, 14, 3, 15, 16, 4};
+    for (int i = 0; i < 9; ++i) {
+        item = readPriority(bundle, NULL);
+        assert((void*)expect[i] == item);
+    }
+    item = readPriority(bundle, NULL);
+    assert(NULL == item);
+    failed = writePriority(bundle, (void*)21, 1) || closePriorityLanes(bundle);
+    assert(!failed);
+    failed = writePriority(bundle, (void*)22, 1);
+    assert(-1 == failed && errno == EPIPE);
+    item = readPriority(bundle, &lane);
+    assert((void*)21 == item && lane == 1);
+    item = readPriority(bundle, NULL);
+    assert(QUEUE_END == item);
+    destroyPriorityLanes(bundle);
+
+    bundle = createPriorityLanes(lanes, 4, 32);
+    assert(bundle);
+    failed = priorityLaneWeight(bundle, 1, 8) || priorityLaneWeight(bundle, 2, 4);
+    assert(!failed);
+    pthread_t thread;
+    failed = pthread_create(&thread, NULL, writer, NULL);
+    assert(!failed);
+    long int got[lanes] = {0};
+    long int total = 0;
+    for (;;) {
+        item = readPriority(bundle, &lane);
+        if (item == QUEUE_END) break;
+        if (!item) {
+            sched_yield();
+            continue;
+        }
+        ++got[lane];
+        assert((long int)item == got[lane]);
+        ++total;
+    }
+    assert(total == theLimit);
+    pthread_join(thread, NULL);
+    item = readPriority(bundle, NULL);
+    assert(QUEUE_END == item);
+    destroyPriorityLanes(bundle);
+    printf("priority lanes ok\n");
+    return 0;
+}
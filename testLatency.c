@@ -0,0 +1,129 @@
+#include "LatencyTrace.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+
+/*
+We test like this.
+First we check the buckets of the histogram and that a single item kept in the
+queue for 20ms is measured as such, and that the stamps of items counted out of
+step are dropped instead of filling the ring.
+Then a write thread sends the numbers from 1 up to "theLimit" through the traced
+calls, stamping every 16th item, and closes the queue while the main thread reads
+them up to its end and checks the order and that the number of measured items
+adds up.
+*/
+
+#define theLimit 1000000
+#define stampEvery 16
+
+static Queue queue;
+static LatencyTrace * trace;
+
+static void * writer(void * arg) {
+    for (long int i = 1; i <= theLimit; ++i)
+        while (tracedWriteItem(trace, &queue, (void*)i)) sched_yield();
+    int const closed = closeQueue(&queue);
+    assert(0 == closed);
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    static void * sectors[8][64];
+    LatencySnapshot snapshot;
+    void * item;
+    int failed = 0;
+
+    for (int b = 1; b < LATENCY_BUCKETS; ++b) assert(latencyBucketLow(b - 1) < latencyBucketLow(b));
+    assert(latencyBucketLow(LATENCY_BUCKETS - 1) > 1ul << 62);
+
+    queue = mkQueue();
+    for (int s = 0; s < 8; ++s) failed |= submitSector(&queue, sectors[s], sizeof(sectors[s]));
+    assert(!failed);
+    TraceConfig config = {1, 4, 0};
+    config.stamps = 3;
+    trace = createLatencyTrace(&config);
+    assert(NULL == trace);
+    config.stamps = 4;
+    trace = createLatencyTrace(&config);
+    assert(trace);
+    failed = tracedWriteItem(trace, &queue, (void*)1);
+    assert(!failed);
+    struct timespec const pause = {0, 20000000};
+    nanosleep(&pause, NULL);
+    item = tracedReadItem(trace, &queue);
+    assert((void*)1 == item);
+    item = tracedReadItem(trace, &queue);
+    assert(NULL == item);
+    latencySnapshot(trace, &snapshot);
+    assert(snapshot.count == 1 && snapshot.missed == 0);
+    assert(snapshot.minNs == snapshot.maxNs);
+    assert(snapshot.maxNs >= 19000000 && snapshot.maxNs < 200000000);
+    assert(latencyPercentile(&snapshot, 0.5) > snapshot.maxNs);
+    /* With the ring full the next items are not stamped. */
+    for (long int i = 1; i <= 6; ++i) failed |= tracedWriteItem(trace, &queue, (void*)i);
+    assert(!failed);
+    for (long int i = 1; i <= 6; ++i) {
+        item = tracedReadItem(trace, &queue);
+        assert((void*)i == item);
+    }
+    latencySnapshot(trace, &snapshot);
+    assert(snapshot.count == 5 && snapshot.missed == 2 && snapshot.stale == 0);
+    /* An item written around the trace puts the read count ahead, its stamps are dropped. */
+    failed = writeItem(&queue, (void*)7);
+    assert(!failed);
+    item = tracedReadItem(trace, &queue);
+    assert((void*)7 == item);
+    for (long int i = 8; i <= 15; ++i) {
+        failed |= tracedWriteItem(trace, &queue, (void*)i);
+        item = tracedReadItem(trace, &queue);
+        assert((void*)i == item);
+    }
+    assert(!failed);
+    latencySnapshot(trace, &snapshot);
+    assert(snapshot.count == 5 && snapshot.missed == 2 && snapshot.stale == 8);
+    failed = tracedWriteItem(NULL, &queue, (void*)1);
+    assert(-1 == failed && EINVAL == errno);
+    item = tracedReadItem(trace, NULL);
+    assert(NULL == item && EINVAL == errno);
+    destroyLatencyTrace(trace);
+
+    queue = mkQueue();
+    failed = 0;
+    for (int s = 0; s < 8; ++s) failed |= submitSector(&queue, sectors[s], sizeof(sectors[s]));
+    assert(!failed);
+    config.every = stampEvery;
+    config.stamps = 64;
+    trace = createLatencyTrace(&config);
+    assert(trace);
+    pthread_t thread;
+    int const created = pthread_create(&thread, NULL, writer, NULL);
+    assert(0 == created);
+    long int i = 1;
+    for (;;) {
+        item = tracedReadItem(trace, &queue);
+        if (item == QUEUE_END) break;
+        if (!item) {
+            sched_yield();
+            continue;
+        }
+        assert((long int)item == i);
+        ++i;
+    }
+    assert(i == theLimit + 1);
+    pthread_join(thread, NULL);
+    latencySnapshot(trace, &snapshot);
+    assert(snapshot.count + snapshot.missed == theLimit / stampEvery && snapshot.stale == 0);
+    unsigned long total = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; ++b) total += snapshot.buckets[b];
+    assert(total == snapshot.count);
+    printf("latency trace ok: %lu measured, median %luns, p99 %luns, max %luns\n",
+            snapshot.count, latencyPercentile(&snapshot, 0.5),
+            latencyPercentile(&snapshot, 0.99), snapshot.maxNs);
+    destroyLatencyTrace(trace);
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include "AsyncLog.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+
+/*
+We test like this.
+First a few records with every kind of argument are logged and the file must
+hold exactly what printf would have written.
+Then "writers" threads log "theLimit" records each, blocking when the queues
+are full, and every line must be in the file, in the order of its thread.
+Then the same with dropping: the lines in the file plus the dropped records
+must add up and every line must still be whole.
+*/
+
+#define writers 3
+#define theLimit 50000
+
+static AsyncLogger * logger;
+
+static void * writer(void * arg) {
+    long int const id = (long int)arg;
+    LogThread * const thread = asyncLogThread(logger);
+    assert(thread);
+    static char const * const names[] = {"alpha", "beta", "gamma"};
+    for (long int i = 0; i < theLimit; ++i)
+        asyncLog(thread, "thread %ld record %ld %s %.1f\n", id, i, names[i % 3], i / 2.0);
+    return NULL;
+}
+
+static char * readAll(FILE * const file, long int * const size) {
+    fflush(file);
+    *size = ftell(file);
+    char * const text = malloc(*size + 1);
+    rewind(file);
+    size_t const got = fread(text, 1, *size, file);
+    assert(got == (size_t)*size);
+    text[*size] = 0;
+    return text;
+}
+
+static long int checkLines(char * const text, int const complete) {
+    long int next[writers] = {0};
+    long int lines = 0;
+    for (char * line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+        long int id, i;
+        char name[16];
+        double half;
+        int const fields = sscanf(line, "thread %ld record %ld %15s %lf", &id, &i, name, &half);
+        assert(4 == fields);
+        assert(id >= 0 && id < writers);
+        assert(complete ? i == next[id] : i >= next[id]);
+        next[id] = i + 1;
+        assert(!strcmp(name, i % 3 == 0 ? "alpha" : i % 3 == 1 ? "beta" : "gamma"));
+        assert(half == i / 2.0);
+        ++lines;
+    }
+    return lines;
+}
+
+int main (int argc, char * argv[]) {
+    char expect[1024];
+    long int size;
+    pthread_t threads[writers];
+    int failed;
+
+    FILE * file = tmpfile();
+    assert(file);
+    logger = createAsyncLogger(fileno(file), 1, 2, 64, logBlock, 4096);
+    assert(NULL == logger);
+    logger = createAsyncLogger(fileno(file), 1, 4, 256, logBlock, 4096);
+    assert(logger);
+    LogThread * const thread = asyncLogThread(logger);
+    LogThread * const extra = asyncLogThread(logger);
+    assert(thread && NULL == extra);
+    char const * const text = "some text";
+    void * const pointer = &size;
+    unsigned char const byte = 200;
+    short const small = -3;
+    failed = asyncLog(thread, "plain line\n");
+    failed |= asyncLog(thread, "%d %5ld %-4lld| %u %x %#o %c %%\n", -7, 42l, 9ll, 3000000000u,
+                255, 8, 'z');
+    failed |= asyncLog(thread, "%s|%10s|%.3s|%f %e %g\n", text, "right", text, 1.5, 250.0, 0.125);
+    failed |= asyncLog(thread, "%p %hhu %hd %zu\n", pointer, byte, small, sizeof(long));
+    failed |= asyncLog(thread, "%d %d missing\n", 1);
+    assert(!failed);
+    destroyAsyncLogger(logger);
+    int length = snprintf(expect, sizeof(expect), "plain line\n");
+    length += snprintf(expect + length, sizeof(expect) - length,
+            "%d %5ld %-4lld| %u %x %#o %c %%\n", -7, 42l, 9ll, 3000000000u, 255, 8, 'z');
+    length += snprintf(expect + length, sizeof(expect) - length,
+            "%s|%10s|%.3s|%f %e %g\n", text, "right", text, 1.5, 250.0, 0.125);
+    length += snprintf(expect + length, sizeof(expect) - length,
+            "%p %hhu %hd %zu\n", pointer, byte, small, sizeof(long));
+    length += snprintf(expect + length, sizeof(expect) - length, "1 %%d missing\n");
+    char * all = readAll(file, &size);
+    assert(size == length && !memcmp(all, expect, length));
+    free(all);
+    fclose(file);
+
+    file = tmpfile();
+    logger = createAsyncLogger(fileno(file), writers, 4, 256, logBlock, 1 << 16);
+    assert(logger);
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    failed = 0;
+    for (long int w = 0; w < writers; ++w) failed |= pthread_create(&threads[w], NULL, writer, (void*)w);
+    assert(!failed);
+    for (int w = 0; w < writers; ++w) pthread_join(threads[w], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    destroyAsyncLogger(logger);
+    all = readAll(file, &size);
+    long int lines = checkLines(all, 1);
+    assert(lines == writers * theLimit);
+    free(all);
+    fclose(file);
+
+    file = tmpfile();
+    logger = createAsyncLogger(fileno(file), writers, 3, 300, logDrop, 1 << 16);
+    assert(logger);
+    failed = 0;
+    for (long int w = 0; w < writers; ++w) failed |= pthread_create(&threads[w], NULL, writer, (void*)w);
+    assert(!failed);
+    for (int w = 0; w < writers; ++w) pthread_join(threads[w], NULL);
+    unsigned long const dropped = asyncLogDropped(logger);
+    destroyAsyncLogger(logger);
+    all = readAll(file, &size);
+    lines = checkLines(all, 0);
+    assert(lines + dropped == writers * theLimit);
+    free(all);
+    fclose(file);
+
+    double const ns = (end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec);
+    printf("async log ok: %.0fns per record, %lu dropped\n", ns / (writers * theLimit), dropped);
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include "OpTrace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+
+/*
+We test like this.
+A write thread sends the numbers from 1 up to "theLimit" through a small queue
+while the main thread reads them, both recording into their recorders. The trace is
+dumped, loaded back and checked: the items written and read add up and the
+operations are in time order.
+Then the same with a writer recorder too small, the trace has to stop where that
+recorder stopped. Last the recovered size on a queue of handles and the reads at
+the end of a closed queue.
+*/
+
+#define theLimit 100000
+
+static void * sectors[4][32];
+
+static Queue queue;
+static OpRecorder * recorders[2];
+
+static void * writer(void * arg) {
+    void * batch[8];
+    for (long int value = 1; value <= theLimit;) {
+        if (value % 3) {
+            if (opWriteItem(recorders[0], &queue, (void*)value)) sched_yield();
+            else ++value;
+            continue;
+        }
+        int const count = theLimit - value < 7 ? theLimit - value + 1 : 8;
+        for (int i = 0; i < count; ++i) batch[i] = (void*)(value + i);
+        int const written = opWriteItems(recorders[0], &queue, batch, count);
+        if (written < count) sched_yield();
+        value += written;
+    }
+    return NULL;
+}
+
+static void run(size_t const writerCapacity) {
+    queue = mkQueue();
+    recorders[0] = createOpRecorder(opWriter, writerCapacity);
+    recorders[1] = createOpRecorder(opReader, 4 * theLimit);
+    assert(recorders[0] && recorders[1]);
+    int failed = 0;
+    for (int s = 0; s < 4; ++s) failed |= opSubmitSector(recorders[0], &queue, sectors[s], sizeof(sectors[s]));
+    assert(!failed);
+    pthread_t thread;
+    int const created = pthread_create(&thread, NULL, writer, NULL);
+    assert(0 == created);
+    void * items[16];
+    for (long int expect = 1; expect <= theLimit;) {
+        if (expect % 2) {
+            void * const item = opReadItem(recorders[1], &queue);
+            if (!item) {
+                sched_yield();
+                continue;
+            }
+            assert((long int)item == expect);
+            ++expect;
+            continue;
+        }
+        int const count = opReadItems(recorders[1], &queue, items, 16);
+        if (!count) sched_yield();
+        for (int i = 0; i < count; ++i, ++expect) assert((long int)items[i] == expect);
+    }
+    pthread_join(thread, NULL);
+    struct QueueSector * const recovered = opRecoverSector(recorders[0], &queue);
+    assert(recovered);
+}
+
+int main (int argc, char * argv[]) {
+    void * items[16];
+    void * item;
+    int result;
+    char path[] = "/tmp/testOpTraceXXXXXX";
+    int const fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    run(4 * theLimit);
+    assert(0 == opRecorderDropped(recorders[0]) && 0 == opRecorderDropped(recorders[1]));
+    result = opTraceDump(path, recorders, 2);
+    assert(0 == result);
+    OpTrace * trace = opTraceLoad(path);
+    assert(trace);
+    unsigned long written = 0, read = 0, submitted = 0, recovered = 0;
+    for (uint64_t e = 0; e < trace->count; ++e) {
+        OpEvent const * const event = &trace->events[e];
+        if (e) assert(trace->events[e - 1].ns <= event->ns);
+        if (event->op == opWrite) written += event->count;
+        if (event->op == opRead) read += event->count;
+        if (event->op == opSubmit) submitted += event->count;
+        if (event->op == opRecover) recovered += event->count;
+        if (event->op == opWrite || event->op == opFull || event->op == opSubmit
+                || event->op == opRecover)
+            assert(event->role == opWriter);
+        else
+            assert(event->role == opReader);
+    }
+    assert(written == theLimit && read == theLimit);
+    assert(submitted == 4 * sizeof(sectors[0]));
+    assert(recovered == QUEUE_SECTOR_SIZE((sizeof(sectors[0]) - QUEUE_SECTOR_SIZE(0)) / sizeof(void*)));
+    destroyOpTrace(trace);
+    destroyOpRecorder(recorders[0]);
+    destroyOpRecorder(recorders[1]);
+
+    run(1000);
+    assert(opRecorderDropped(recorders[0]));
+    result = opTraceDump(path, recorders, 2);
+    assert(0 == result);
+    trace = opTraceLoad(path);
+    assert(trace && trace->count > 1000 && trace->count < 4 * theLimit);
+    unsigned long writerEvents = 0;
+    for (uint64_t e = 0; e < trace->count; ++e) writerEvents += trace->events[e].role == opWriter;
+    assert(writerEvents == 1000);
+    destroyOpTrace(trace);
+    destroyOpRecorder(recorders[0]);
+    destroyOpRecorder(recorders[1]);
+
+    /* A queue of handles: the recovered size counts 4 bytes an item. */
+    Queue handles = mkHandleQueue(NULL, 4, 0);
+    recorders[0] = createOpRecorder(opWriter, 8);
+    assert(recorders[0]);
+    result = opSubmitSector(recorders[0], &handles, sectors[0], sizeof(sectors[0]));
+    assert(0 == result);
+    struct QueueSector * const sector = opRecoverSector(recorders[0], &handles);
+    assert(sector);
+    result = opTraceDump(path, recorders, 1);
+    assert(0 == result);
+    trace = opTraceLoad(path);
+    assert(trace && trace->count == 2 && trace->events[1].op == opRecover);
+    assert(trace->events[1].count == QUEUE_HANDLE_SECTOR_SIZE(
+                (sizeof(sectors[0]) - QUEUE_HANDLE_SECTOR_SIZE(0, 4)) / 4, 4));
+    destroyOpTrace(trace);
+    destroyOpRecorder(recorders[0]);
+
+    /* The end of a closed queue is recorded as empty reads. */
+    Queue closing = mkQueue();
+    recorders[1] = createOpRecorder(opReader, 8);
+    assert(recorders[1]);
+    result = submitSector(&closing, sectors[0], sizeof(sectors[0]));
+    result |= writeItem(&closing, (void*)1);
+    result |= writeItem(&closing, (void*)2);
+    result |= closeQueue(&closing);
+    assert(0 == result);
+    result = opReadItems(recorders[1], &closing, items, 16);
+    assert(2 == result);
+    result = opReadItems(recorders[1], &closing, items, 16);
+    assert(-1 == result && errno == EPIPE);
+    item = opReadItem(recorders[1], &closing);
+    assert(QUEUE_END == item);
+    result = opTraceDump(path, recorders + 1, 1);
+    assert(0 == result);
+    trace = opTraceLoad(path);
+    assert(trace && trace->count == 3);
+    assert(trace->events[0].op == opRead && trace->events[0].count == 2);
+    assert(trace->events[1].op == opEmpty && trace->events[2].op == opEmpty);
+    destroyOpTrace(trace);
+    destroyOpRecorder(recorders[1]);
+
+    /* A header counting more events than the file holds is refused. */
+    FILE * const damaged = fopen(path, "r+b");
+    assert(damaged);
+    uint64_t const count = ~(uint64_t)0 / 2;
+    result = fseek(damaged, 8, SEEK_SET);
+    assert(0 == result);
+    size_t const put = fwrite(&count, sizeof(count), 1, damaged);
+    assert(1 == put);
+    fclose(damaged);
+    trace = opTraceLoad(path);
+    assert(NULL == trace && errno == EINVAL);
+
+    result = unlink(path);
+    assert(0 == result);
+    trace = opTraceLoad(path);
+    assert(NULL == trace);
+    printf("op trace ok\n");
+    return 0;
+}
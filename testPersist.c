@@ -0,0 +1,89 @@
+#include "PersistQueue.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+
+/*
+We test like this.
+A writer writes into a new file, a reader takes a part and goes away, the next
+reader goes on where it stopped. The writer goes away too and the next one
+goes on writing. Then a child process writes until the queue is full and is
+killed: a new writer takes over and the reader finds all the values in order.
+*/
+
+int main (int argc, char * argv[]) {
+    char path[] = "/tmp/testPersistXXXXXX";
+    int const fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    PersistQueue writer = mkPersistQueue(), reader = mkPersistQueue(), other;
+    uint64_t item;
+    int result = persistQueueOpen(&writer, path, shmWriter, 4, 64, persistSector, 0);
+    assert(0 == result);
+    result = persistQueueOpen(&other, path, shmWriter, 4, 64, persistNone, 0);
+    assert(-1 == result && errno == EBUSY);
+    result = 0;
+    for (uint64_t i = 1; i <= 100; ++i) result |= persistWriteItem(&writer, i);
+    assert(0 == result);
+    result = persistQueueOpen(&reader, path, shmReader, 2, 8, persistBatch, 16);
+    assert(0 == result);
+    for (uint64_t i = 1; i <= 40; ++i) {
+        result = persistReadItem(&reader, &item);
+        assert(0 == result && item == i);
+    }
+    result = persistQueueClose(&reader);
+    assert(0 == result);
+    result = persistQueueOpen(&reader, path, shmReader, 2, 8, persistBatch, 16);
+    assert(0 == result);
+    result = persistReadItem(&reader, &item);
+    assert(0 == result && item == 41);
+    result = persistQueueClose(&writer);
+    assert(0 == result);
+    result = persistQueueOpen(&writer, path, shmWriter, 2, 8, persistNone, 0);
+    assert(0 == result);
+    assert(writer.shm.size == shmQueueSize(4, 64));
+    for (uint64_t i = 101; i <= 200; ++i) result |= persistWriteItem(&writer, i);
+    result |= persistQueueClose(&writer);
+    assert(0 == result);
+
+    pid_t const child = fork();
+    assert(child >= 0);
+    if (!child) {
+        PersistQueue mine = mkPersistQueue();
+        if (persistQueueOpen(&mine, path, shmWriter, 4, 64, persistNone, 0)) _exit(1);
+        for (uint64_t i = 201;;)
+            if (persistWriteItem(&mine, i)) usleep(1000);
+            else ++i;
+    }
+    usleep(100000);
+    assert(shmQueuePeerAlive(&reader.shm, shmWriter));
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    result = persistQueueOpen(&writer, path, shmWriter, 4, 64, persistBatch, 4);
+    assert(0 == result);
+    uint64_t expect = 42;
+    while (!persistReadItem(&reader, &item)) {
+        assert(item == expect);
+        ++expect;
+    }
+    assert(expect > 200);
+    result = persistWriteItem(&writer, 1000000);
+    assert(0 == result);
+    result = persistReadItem(&reader, &item);
+    assert(0 == result && item == 1000000);
+    result = persistReadItem(&reader, &item);
+    assert(-1 == result && errno == EAGAIN);
+    result = persistQueueClose(&writer);
+    result |= persistQueueClose(&reader);
+    assert(0 == result);
+
+    result = unlink(path);
+    assert(0 == result);
+    printf("persistent queue ok\n");
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "Pipeline.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+Four stages: "decode" doubles every number, "enrich" adds one, "route" drops
+the numbers that are multiple of 3 and "serialize" checks that what is left
+arrives in order.
+We push the numbers from 1 up to "theLimit", some one by one and some in
+batches, and at the end the last stage must have seen all of them.
+*/
+
+#define theLimit 300000
+
+static int decode(void ** items, int count, void ** out, void * context) {
+    for (int i = 0; i < count; ++i) out[i] = (void*)((long int)items[i] * 2);
+    return count;
+}
+
+static int enrich(void ** items, int count, void ** out, void * context) {
+    for (int i = 0; i < count; ++i) out[i] = (void*)((long int)items[i] + 1);
+    return count;
+}
+
+static int route(void ** items, int count, void ** out, void * context) {
+    int emitted = 0;
+    for (int i = 0; i < count; ++i)
+        if ((long int)items[i] % 3) out[emitted++] = items[i];
+    return emitted;
+}
+
+static int serialize(void ** items, int count, void ** out, void * context) {
+    long int * const last = context;
+    assert(!out);
+    for (int i = 0; i < count; ++i) {
+        long int const value = (long int)items[i];
+        long int expect = *last + 2;
+        if (expect % 3 == 0) expect += 2;
+        assert(value == expect);
+        *last = value;
+    }
+    return 0;
+}
+
+int main (int argc, char * argv[]) {
+    PipelineConfig const config = {4, 64, 32};
+    long int last = 1;
+    Pipeline * const pipeline = createPipeline(&config);
+    assert(pipeline);
+    int failed = pipelineAddStage(pipeline, decode, NULL, 0);
+    failed |= pipelineAddStage(pipeline, enrich, NULL, -1);
+    failed |= pipelineAddStage(pipeline, route, NULL, -1);
+    failed |= pipelineAddStage(pipeline, serialize, &last, 0);
+    failed |= pipelineStart(pipeline);
+    assert(!failed);
+    void * batch[50];
+    for (long int value = 1; value <= theLimit;) {
+        if (value & 1) {
+            while (pipelinePush(pipeline, (void*)value)) sched_yield();
+            ++value;
+            continue;
+        }
+        int count = 0;
+        for (; count < 50 && value + count <= theLimit; ++count)
+            batch[count] = (void*)(value + count);
+        for (int done = 0; done < count;) {
+            int const pushed = pipelinePushBatch(pipeline, batch + done, count - done);
+            assert(pushed >= 0);
+            if (!pushed) sched_yield();
+            done += pushed;
+        }
+        value += count;
+    }
+    pipelineFlush(pipeline);
+    assert(last == theLimit * 2 + 1 || last == theLimit * 2 - 1);
+    StageStats stats;
+    for (int s = 0; s < 4; ++s) {
+        failed = pipelineStats(pipeline, s, &stats);
+        assert(!failed);
+        printf("stage %d: %lu batches %lu in %lu out %.1f%% busy\n", s,
+                stats.batches, stats.itemsIn, stats.itemsOut,
+                stats.utilisation * 100);
+    }
+    failed = pipelineStats(pipeline, 2, &stats);
+    assert(!failed);
+    assert(stats.itemsIn == theLimit && stats.itemsOut < theLimit);
+    destroyPipeline(pipeline);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "ThreadPool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+Two submitters (the main thread and a helper thread) push the numbers from 1
+up to "theLimit" into a pool, some of them one by one and some in batches.
+Every handler call marks its number as seen, the slow numbers keep their worker
+busy so that the idle workers have something to steal.
+At the end every number must be seen exactly once.
+Then six submitters push everything to one of two workers, whose batch is much
+larger then the donation queue of the other, so a donation is only a part of
+the half batch; again every number must be seen exactly once.
+*/
+
+#define theLimit 200000
+
+static int volatile seen[theLimit + 1];
+
+static void handler(void * item, void * context) {
+    long int const value = (long int)item;
+    assert(value > 0 && value <= theLimit);
+    ++seen[value];
+    if (value % 1000 == 0)
+        for (int volatile i = 0; i < 10000; ++i);
+}
+
+typedef struct Range {
+    ThreadPool * pool;
+    int submitter;
+    long int first;
+    long int last;
+} Range;
+
+static void * submitRange(void * arg) {
+    Range const * const range = arg;
+    void * batch[64];
+    for (long int value = range->first; value <= range->last;) {
+        if (value % 3) {
+            while (poolSubmit(range->pool, range->submitter, (void*)value))
+                sched_yield();
+            ++value;
+            continue;
+        }
+        int count = 0;
+        for (; count < 64 && value + count <= range->last; ++count)
+            batch[count] = (void*)(value + count);
+        for (int done = 0; done < count;) {
+            int const written = poolSubmitBatch(range->pool, range->submitter,
+                    batch + done, count - done);
+            assert(written >= 0);
+            if (!written) sched_yield();
+            done += written;
+        }
+        value += count;
+    }
+    return NULL;
+}
+
+static void * submitToFirst(void * arg) {
+    Range const * const range = arg;
+    for (long int value = range->first; value <= range->last; ++value)
+        while (poolSubmitTo(range->pool, range->submitter, 0, (void*)value))
+            sched_yield();
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    int const cpus[4] = {0, -1, 0, -1};
+    PoolConfig const config = {4, 2, 4, 128, 32, cpus, handler, NULL};
+    ThreadPool * const pool = createThreadPool(&config);
+    assert(pool);
+    Range first = {pool, 0, 1, theLimit / 2};
+    Range second = {pool, 1, theLimit / 2 + 1, theLimit};
+    pthread_t helper;
+    int const created = pthread_create(&helper, NULL, submitRange, &second);
+    assert(0 == created);
+    submitRange(&first);
+    pthread_join(helper, NULL);
+    poolWait(pool);
+    assert(poolSubmitted(pool) == theLimit);
+    assert(poolCompleted(pool) == theLimit);
+    unsigned long stolen = 0;
+    for (int w = 0; w < 4; ++w) stolen += poolWorkerStolen(pool, w);
+    destroyThreadPool(pool);
+    for (int i = 1; i <= theLimit; ++i) assert(seen[i] == 1);
+
+    for (int i = 1; i <= theLimit; ++i) seen[i] = 0;
+    PoolConfig const narrow = {2, 6, 2, 8, 80, NULL, handler, NULL};
+    ThreadPool * const crowded = createThreadPool(&narrow);
+    assert(crowded);
+    Range ranges[6];
+    pthread_t submitters[6];
+    for (int s = 0; s < 6; ++s) {
+        Range const range = {crowded, s, theLimit / 6 * s + 1,
+            s == 5 ? theLimit : theLimit / 6 * (s + 1)};
+        ranges[s] = range;
+        int const started = pthread_create(&submitters[s], NULL, submitToFirst, &ranges[s]);
+        assert(0 == started);
+    }
+    for (int s = 0; s < 6; ++s) pthread_join(submitters[s], NULL);
+    poolWait(crowded);
+    assert(poolCompleted(crowded) == theLimit);
+    stolen += poolWorkerStolen(crowded, 1);
+    destroyThreadPool(crowded);
+    for (int i = 1; i <= theLimit; ++i) assert(seen[i] == 1);
+    printf("pool ok, %lu items stolen\n", stolen);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "QueueSet.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+First one thread writes into a few queues of a big set and checks that
+selectRead finds exactly those, honouring the weights.
+Then four write threads, each the writer of a quarter of the queues, send the
+numbers from 1 up to "theLimit" to every queue of theirs while the main thread
+reads with selectRead and checks that every queue keeps its order.
+*/
+
+#define queueCount 200
+#define writers 4
+#define theLimit 20000
+
+static QueueSet * set;
+
+static void * writer(void * arg) {
+    long int const first = (long int)arg;
+    void * batch[8];
+    for (long int value = 1; value <= theLimit;) {
+        for (int index = first; index < queueCount; index += writers) {
+            if (value & 1) {
+                while (queueSetWrite(set, index, (void*)value)) sched_yield();
+                continue;
+            }
+            int const count = theLimit - value < 7 ? theLimit - value + 1 : 8;
+            for (int i = 0; i < count; ++i) batch[i] = (void*)(value + i);
+            for (int done = 0; done < count;) {
+                int const written = queueSetWriteItems(set, index, batch + done, count - done);
+                if (!written) sched_yield();
+                done += written;
+            }
+        }
+        value += value & 1 ? 1 : 8;
+    }
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    void * items[64];
+    int sources[64];
+
+    set = createQueueSet(queueCount, 4, 32);
+    assert(set);
+    int failed = queueSetWeight(set, 150, 3) || queueSetWrite(set, 7, (void*)1);
+    for (long int i = 1; i <= 5; ++i) failed |= queueSetWrite(set, 150, (void*)i);
+    failed |= queueSetWrite(set, 199, (void*)1);
+    assert(!failed);
+    int count = selectRead(set, items, sources, 64);
+    assert(count == 5);
+    assert(sources[0] == 7 && sources[1] == 150 && sources[3] == 150 && sources[4] == 199);
+    assert(items[3] == (void*)3);
+    count = selectRead(set, items, sources, 64);
+    assert(count == 2 && sources[0] == 150 && items[1] == (void*)5);
+    count = selectRead(set, items, sources, 64);
+    assert(0 == count);
+    destroyQueueSet(set);
+
+    set = createQueueSet(queueCount, 4, 32);
+    assert(set);
+    for (int i = 0; i < queueCount; i += 3) queueSetWeight(set, i, 4);
+    pthread_t threads[writers];
+    for (long int w = 0; w < writers; ++w) {
+        failed = pthread_create(&threads[w], NULL, writer, (void*)w);
+        assert(!failed);
+    }
+    static long int expect[queueCount];
+    long int total = 0;
+    while (total < (long int)queueCount * theLimit) {
+        count = selectRead(set, items, sources, 64);
+        if (!count) sched_yield();
+        for (int i = 0; i < count; ++i) {
+            ++expect[sources[i]];
+            assert((long int)items[i] == expect[sources[i]]);
+            ++total;
+        }
+    }
+    for (int w = 0; w < writers; ++w) pthread_join(threads[w], NULL);
+    count = selectRead(set, items, sources, 64);
+    assert(0 == count);
+    destroyQueueSet(set);
+    printf("queue set ok\n");
+    return 0;
+}
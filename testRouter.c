@@ -0,0 +1,183 @@
+#include "Router.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+An item is a number, its key the low bits and its order among the items of
+its key the high bits.
+Four worker threads read the partitions of a router while the main thread
+routes "theLimit" items over "keyCount" keys. Every worker claims the keys it
+sees and checks that no other worker saw them and that the items of a key come
+in order.
+Then, with no threads, a stream where one key is half of the items is routed
+without and with the hot key split, the split must lower the skew. And a
+stream of many keys, none of them hot, must not be split even with a share
+below what the table of the busiest keys can tell.
+*/
+
+#define partitionCount 4
+#define keyCount 1000
+#define keyBits 10
+#define theLimit 400000
+
+static uint64_t keyOf(void const * item, void * context) {
+    return (unsigned long)item & ((1 << keyBits) - 1);
+}
+
+static Router * router;
+static int volatile owner[keyCount];
+static long int volatile seen;
+
+static void * worker(void * arg) {
+    int const id = (long int)arg + 1;
+    Queue * const queue = routerQueue(router, id - 1);
+    static __thread long int last[keyCount];
+    void * items[64];
+    while (seen < theLimit) {
+        int const count = readItems(queue, items, 64);
+        if (!count) {
+            sched_yield();
+            continue;
+        }
+        for (int i = 0; i < count; ++i) {
+            long int const item = (long int)items[i];
+            int const key = keyOf(items[i], NULL);
+            if (owner[key] != id) {
+                /* A key taken by another worker would break the order of its items. */
+                int const taken = __sync_bool_compare_and_swap(&owner[key], 0, id);
+                assert(taken);
+            }
+            assert(item >> keyBits == last[key] + 1);
+            last[key] = item >> keyBits;
+        }
+        __sync_fetch_and_add(&seen, count);
+    }
+    return NULL;
+}
+
+/** Routes a stream where key 7 is every other item and drains the queues. */
+static double skewed(int const split) {
+    router = createRouter(partitionCount, 4, 64, 16, keyOf, NULL);
+    assert(router);
+    int failed = split ? routerHotSplit(router, 0.2, partitionCount) : 0;
+    assert(!failed);
+    void * items[64];
+    for (long int i = 1; i <= 100000; ++i) {
+        long int const key = i & 1 ? 7 : rand() % keyCount;
+        while (routerWrite(router, (void*)(i << keyBits | key))) {
+            assert(errno == ENOMEM);
+            for (int p = 0; p < partitionCount; ++p)
+                while (readItems(routerQueue(router, p), items, 64) > 0);
+        }
+    }
+    PartitionStats stats;
+    unsigned long hot = 0;
+    for (int p = 0; p < partitionCount; ++p) {
+        failed = routerStats(router, p, &stats);
+        assert(!failed);
+        hot += stats.hotItems;
+    }
+    assert(split ? hot > 40000 : !hot);
+    double const skew = routerSkew(router);
+    destroyRouter(router);
+    return skew;
+}
+
+/** Routes a stream over many keys evenly, @return the items taken as hot. */
+static unsigned long uniform(void) {
+    router = createRouter(8, 4, 64, 16, keyOf, NULL);
+    assert(router);
+    int failed = routerHotSplit(router, 0.05, 4);
+    assert(!failed);
+    void * items[64];
+    for (long int i = 1; i <= 20000; ++i) {
+        long int const key = rand() % keyCount;
+        while (routerWrite(router, (void*)(i << keyBits | key)))
+            for (int p = 0; p < 8; ++p)
+                while (readItems(routerQueue(router, p), items, 64) > 0);
+    }
+    PartitionStats stats;
+    unsigned long hot = 0;
+    for (int p = 0; p < 8; ++p) {
+        failed = routerStats(router, p, &stats);
+        assert(!failed);
+        hot += stats.hotItems;
+    }
+    destroyRouter(router);
+    return hot;
+}
+
+int main (int argc, char * argv[]) {
+    pthread_t threads[partitionCount];
+    void * items[16];
+    int result;
+
+    router = createRouter(2, 4, 8, 4, NULL, NULL);
+    assert(!router && errno == EINVAL);
+    router = createRouter(2, 2, 4, 4, keyOf, NULL);
+    assert(router && 0 == routerSkew(router));
+    result = routerHotSplit(router, 0.5, 3);
+    assert(-1 == result && errno == EINVAL);
+    /* The same key every time: a batch of 4 is written at once. */
+    result = 0;
+    for (long int i = 1; i <= 3; ++i) result |= routerWrite(router, (void*)(i << keyBits | 5));
+    assert(0 == result);
+    result = readItems(routerQueue(router, 0), items, 16);
+    result |= readItems(routerQueue(router, 1), items, 16);
+    assert(0 == result);
+    result = routerWrite(router, (void*)(4l << keyBits | 5));
+    assert(0 == result);
+    int const count = readItems(routerQueue(router, 0), items, 16)
+        + readItems(routerQueue(router, 1), items, 16);
+    assert(count == 4 && items[3] == (void*)(4l << keyBits | 5));
+    /* Two sectors of 4 plus a batch of 4 and the partition is full. */
+    for (long int i = 5; i <= 16; ++i) result |= routerWrite(router, (void*)(i << keyBits | 5));
+    assert(0 == result);
+    result = routerWrite(router, (void*)(17l << keyBits | 5));
+    assert(-1 == result && errno == ENOMEM);
+    result = routerFlush(router);
+    assert(4 == result);
+    PartitionStats stats;
+    result = routerStats(router, 0, &stats);
+    if (!result && !stats.items) result = routerStats(router, 1, &stats);
+    assert(0 == result);
+    assert(stats.items == 16 && stats.batches == 3 && stats.full >= 1);
+    assert(2 == routerSkew(router));
+    destroyRouter(router);
+
+    router = createRouter(partitionCount, 4, 64, 16, keyOf, NULL);
+    assert(router);
+    result = 0;
+    for (long int p = 0; p < partitionCount; ++p)
+        result |= pthread_create(&threads[p], NULL, worker, (void*)p);
+    assert(0 == result);
+    static long int order[keyCount];
+    for (long int i = 0; i < theLimit;) {
+        int const key = rand() % keyCount;
+        if (routerWrite(router, (void*)((order[key] + 1) << keyBits | key))) {
+            routerFlush(router);
+            sched_yield();
+            continue;
+        }
+        ++order[key];
+        ++i;
+    }
+    while (routerFlush(router)) sched_yield();
+    for (int p = 0; p < partitionCount; ++p) pthread_join(threads[p], NULL);
+    double const skew = routerSkew(router);
+    assert(skew >= 1 && skew < 1.2);
+    destroyRouter(router);
+
+    double const plain = skewed(0);
+    double const split = skewed(1);
+    assert(plain > 2 && split < plain);
+    unsigned long const hot = uniform();
+    assert(hot < 200);
+    printf("router ok, skew %.2f without the split, %.2f with it\n", plain, split);
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "RpcChannel.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+/*
+We test like this.
+First one thread plays both sides and checks the ids, the responses and the
+slots running out.
+Then a server thread answers every request with the request plus 1 while the
+main thread makes "theLimit" calls, up to 32 in flight, checks every response
+against its call and prints the mean round trip.
+*/
+
+#define theLimit 200000
+#define inFlight 32
+
+static RpcChannel * channel;
+static int volatile stop;
+
+static void * server(void * arg) {
+    RpcCall * calls[16];
+    while (!stop) {
+        int const count = rpcReceive(channel, calls, 16);
+        if (!count) sched_yield();
+        for (int i = 0; i < count; ++i) {
+            calls[i]->response = (char *)calls[i]->request + 1;
+            calls[i]->status = 7;
+            while (rpcReply(channel, calls[i])) sched_yield();
+        }
+    }
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    RpcCall * calls[4];
+    RpcCall completed[64];
+
+    channel = createRpcChannel(2, 4);
+    assert(channel);
+    uint64_t const first = rpcCall(channel, (void*)10, (void*)1);
+    uint64_t const second = rpcCall(channel, (void*)20, (void*)2);
+    assert(first && second && first != second);
+    uint64_t id = rpcCall(channel, (void*)30, NULL);
+    assert(0 == id);
+    int result = rpcPoll(channel, completed, 64);
+    assert(0 == result);
+    result = rpcReceive(channel, calls, 4);
+    assert(2 == result);
+    assert(calls[0]->id == first && calls[0]->request == (void*)10);
+    calls[1]->response = (void*)21;
+    result = rpcReply(channel, calls[1]);
+    assert(0 == result);
+    result = rpcReply(channel, NULL);
+    assert(-1 == result && errno == EINVAL);
+    id = rpcCall(NULL, (void*)30, NULL);
+    assert(0 == id && errno == EINVAL);
+    result = rpcReceive(NULL, calls, 4);
+    assert(-1 == result && errno == EINVAL);
+    result = rpcReceive(channel, NULL, 4);
+    assert(-1 == result && errno == EINVAL);
+    result = rpcPoll(channel, completed, -1);
+    assert(-1 == result && errno == EINVAL);
+    result = rpcPoll(channel, NULL, 64);
+    assert(-1 == result && errno == EINVAL);
+    result = rpcPoll(channel, completed, 64);
+    assert(1 == result);
+    assert(completed[0].id == second && completed[0].response == (void*)21);
+    assert(completed[0].context == (void*)2);
+    id = rpcCall(channel, (void*)30, NULL);
+    assert(id);
+    destroyRpcChannel(channel);
+
+    channel = createRpcChannel(inFlight, 16);
+    assert(channel);
+    pthread_t thread;
+    result = pthread_create(&thread, NULL, server, NULL);
+    assert(0 == result);
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    long int sent = 0, done = 0;
+    while (done < theLimit) {
+        while (sent < theLimit && rpcCall(channel, (void*)(sent * 2), (void*)sent)) ++sent;
+        int const count = rpcPoll(channel, completed, 64);
+        if (!count) sched_yield();
+        for (int i = 0; i < count; ++i) {
+            long int const which = (long int)completed[i].context;
+            assert(completed[i].id == (uint64_t)which + 1);
+            assert(completed[i].response == (void*)(which * 2 + 1));
+            assert(completed[i].status == 7);
+        }
+        done += count;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stop = 1;
+    pthread_join(thread, NULL);
+    double const ns = (end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec);
+    printf("rpc channel ok: %.0fns per call\n", ns / theLimit);
+    destroyRpcChannel(channel);
+    return 0;
+}
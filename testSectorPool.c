@@ -0,0 +1,151 @@
+#include "SectorPool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+First four threads take and give back sectors of a small pool through their
+caches, each marking the sectors it holds and checking that nobody else wrote
+into them, so a sector is never handed to two threads.
+Then four write threads, each the writer of two queues, send the numbers from
+1 up to "theLimit" to every queue of theirs, all the sectors coming from one
+pool smaller then the queues would need apart. When a queue is full the write
+thread trims its queues and tries again. The main thread reads all the queues
+and checks the order. At the end the queues are closed and give all their
+sectors back, and the pool must have all of them.
+*/
+
+#define threadCount 4
+#define queuesPerThread 2
+#define queueCount (threadCount * queuesPerThread)
+#define poolSectors 40
+#define itemsPerSector 32
+#define theLimit 200000
+
+static SectorPool * pool;
+static Queue queues[queueCount];
+
+static void * juggler(void * arg) {
+    long int const id = (long int)arg + 1;
+    SectorCache * const cache = createSectorCache(pool, 4);
+    assert(cache);
+    long int * held[6];
+    for (int round = 0; round < 20000; ++round) {
+        int count = 0;
+        for (; count < 1 + round % 6; ++count) {
+            held[count] = sectorPoolAlloc(cache);
+            if (!held[count]) break;
+            *held[count] = id;
+        }
+        sched_yield();
+        for (int i = 0; i < count; ++i) {
+            assert(*held[i] == id);
+            sectorPoolFree(cache, held[i]);
+        }
+    }
+    destroySectorCache(cache);
+    return NULL;
+}
+
+static void * writer(void * arg) {
+    Queue * const mine = queues + (long int)arg * queuesPerThread;
+    SectorCache * const cache = createSectorCache(pool, 4);
+    assert(cache);
+    void * batch[5];
+    for (long int value = 1; value <= theLimit;) {
+        int const count = value % 3 ? 1 : theLimit - value < 4 ? theLimit - value + 1 : 5;
+        for (int q = 0; q < queuesPerThread; ++q) {
+            for (int i = 0; i < count; ++i) batch[i] = (void*)(value + i);
+            for (int done = 0; done < count;) {
+                int const written = count == 1
+                    ? sectorPoolWriteItem(cache, &mine[q], batch[0]) ? 0 : 1
+                    : sectorPoolWriteItems(cache, &mine[q], batch + done, count - done);
+                assert(written >= 0);
+                done += written;
+                if (done == count) break;
+                assert(errno == ENOMEM);
+                for (int t = 0; t < queuesPerThread; ++t) sectorPoolTrim(cache, &mine[t], 0);
+                sched_yield();
+            }
+        }
+        value += count;
+        if (!(value & 1023))
+            for (int q = 0; q < queuesPerThread; ++q) sectorPoolTrim(cache, &mine[q], 1);
+    }
+    for (int q = 0; q < queuesPerThread; ++q) {
+        int const closed = closeQueue(&mine[q]);
+        assert(0 == closed);
+        int given;
+        while ((given = sectorPoolReleaseQueue(cache, &mine[q])) < 0) {
+            assert(errno == EAGAIN);
+            sched_yield();
+        }
+        assert(given > 0);
+    }
+    destroySectorCache(cache);
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    pthread_t threads[threadCount];
+    int failed = 0;
+
+    pool = createSectorPool(poolSectors, itemsPerSector);
+    assert(pool);
+    assert(sectorPoolSectorSize(pool) >= QUEUE_SECTOR_SIZE(itemsPerSector));
+    assert(sectorPoolSectorSize(pool) % 64 == 0);
+    SectorCache * cache = createSectorCache(pool, 1);
+    assert(!cache && errno == EINVAL);
+    cache = createSectorCache(pool, 8);
+    assert(cache);
+    void * taken[poolSectors];
+    for (int i = 0; i < poolSectors; ++i) {
+        taken[i] = sectorPoolAlloc(cache);
+        assert(taken[i]);
+    }
+    void * const extra = sectorPoolAlloc(cache);
+    assert(!extra && errno == ENOMEM);
+    assert(0 == sectorPoolAvailable(pool));
+    for (int i = 0; i < poolSectors; ++i) sectorPoolFree(cache, taken[i]);
+    assert(sectorPoolAvailable(pool) > 0 && sectorPoolAvailable(pool) < poolSectors);
+    destroySectorCache(cache);
+    assert(poolSectors == sectorPoolAvailable(pool));
+
+    for (long int t = 0; t < threadCount; ++t) failed |= pthread_create(&threads[t], NULL, juggler, (void*)t);
+    assert(!failed);
+    for (int t = 0; t < threadCount; ++t) pthread_join(threads[t], NULL);
+    assert(poolSectors == sectorPoolAvailable(pool));
+
+    for (int q = 0; q < queueCount; ++q) queues[q] = mkQueue();
+    for (long int t = 0; t < threadCount; ++t) failed |= pthread_create(&threads[t], NULL, writer, (void*)t);
+    assert(!failed);
+    long int expect[queueCount] = {0};
+    int ended = 0;
+    while (ended < queueCount) {
+        int idle = 1;
+        for (int q = 0; q < queueCount; ++q) {
+            if (expect[q] > theLimit) continue;
+            void * const item = readItem(&queues[q]);
+            if (!item) continue;
+            idle = 0;
+            if (item == QUEUE_END) {
+                assert(expect[q] == theLimit);
+                expect[q] = theLimit + 1;
+                ++ended;
+                continue;
+            }
+            ++expect[q];
+            assert((long int)item == expect[q]);
+        }
+        if (idle) sched_yield();
+    }
+    for (int t = 0; t < threadCount; ++t) pthread_join(threads[t], NULL);
+    assert(poolSectors == sectorPoolAvailable(pool));
+    destroySectorPool(pool);
+    printf("sector pool ok\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "Sequencer.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+First, with no threads, the window stops the dispatch and one late item holds
+back the results of the ones after it.
+Then, with every policy, the main thread dispatches the numbers from 1 up to
+"theLimit" to four worker threads that take longer on some numbers then on
+others, a collect thread checks that the doubled numbers come back in order.
+*/
+
+#define workerCount 4
+#define theLimit 200000
+
+static Sequencer * sequencer;
+static int volatile stop;
+
+static void * worker(void * arg) {
+    int const id = (long int)arg;
+    while (!stop) {
+        SequencedItem * const envelope = sequencerTake(sequencer, id);
+        if (!envelope) {
+            sched_yield();
+            continue;
+        }
+        long int const value = (long int)envelope->item;
+        /* Some items take much longer, so they overtake each other. */
+        for (int volatile spin = value % 7 * 100; spin; --spin);
+        envelope->result = (void*)(value * 2);
+        while (sequencerPut(sequencer, id, envelope)) sched_yield();
+    }
+    return NULL;
+}
+
+static void * collector(void * arg) {
+    void * results[32];
+    for (long int expect = 1; expect <= theLimit;) {
+        int const count = sequencerCollect(sequencer, results, 32);
+        if (!count) sched_yield();
+        for (int i = 0; i < count; ++i, ++expect)
+            assert((long int)results[i] == expect * 2);
+    }
+    return NULL;
+}
+
+static void run(int const policy) {
+    pthread_t workers[workerCount], collect;
+    sequencer = createSequencer(workerCount, 256, 4, 32, policy);
+    assert(sequencer);
+    stop = 0;
+    int failed = 0;
+    for (long int w = 0; w < workerCount; ++w) failed |= pthread_create(&workers[w], NULL, worker, (void*)w);
+    failed |= pthread_create(&collect, NULL, collector, NULL);
+    assert(!failed);
+    for (long int value = 1; value <= theLimit;) {
+        if (sequencerDispatch(sequencer, (void*)value)) {
+            assert(errno == ENOMEM);
+            sched_yield();
+        } else ++value;
+    }
+    pthread_join(collect, NULL);
+    stop = 1;
+    for (int w = 0; w < workerCount; ++w) pthread_join(workers[w], NULL);
+    destroySequencer(sequencer);
+}
+
+int main (int argc, char * argv[]) {
+    void * results[8];
+    int result = 0;
+
+    sequencer = createSequencer(2, 4, 2, 8, 7);
+    assert(!sequencer && errno == EINVAL);
+    sequencer = createSequencer(2, 4, 2, 8, sequenceRoundRobin);
+    assert(sequencer);
+    for (long int i = 1; i <= 4; ++i) result |= sequencerDispatch(sequencer, (void*)i);
+    assert(0 == result);
+    result = sequencerDispatch(sequencer, (void*)5);
+    assert(-1 == result && errno == ENOMEM);
+    SequencedItem * const first = sequencerTake(sequencer, 0);
+    SequencedItem * const second = sequencerTake(sequencer, 1);
+    assert(first->sequence == 0 && first->item == (void*)1);
+    assert(second->sequence == 1 && second->item == (void*)2);
+    second->result = (void*)20;
+    result = sequencerPut(sequencer, 1, second);
+    assert(0 == result);
+    result = sequencerCollect(sequencer, results, 8);
+    assert(0 == result);
+    first->result = (void*)10;
+    result = sequencerPut(sequencer, 0, first);
+    assert(0 == result);
+    result = sequencerCollect(sequencer, results, 8);
+    assert(2 == result);
+    assert(results[0] == (void*)10 && results[1] == (void*)20);
+    result = sequencerDispatch(sequencer, (void*)5);
+    assert(0 == result);
+    SequencedItem * taken = sequencerTake(sequencer, 0);
+    assert(taken && taken->sequence == 2);
+    taken = sequencerTake(sequencer, 0);
+    assert(taken && taken->sequence == 4);
+    taken = sequencerTake(sequencer, 0);
+    assert(!taken);
+    destroySequencer(sequencer);
+
+    run(sequenceRoundRobin);
+    run(sequenceLeastLoaded);
+    printf("sequencer ok\n");
+    return 0;
+}
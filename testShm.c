@@ -0,0 +1,121 @@
+#define _GNU_SOURCE
+#include "ShmQueue.h"
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+
+/*
+We test like this.
+First a child process attaches to the queue as reader and expects the numbers
+from 1 up to "theLimit" in order, while the parent writes them.
+Then, a few times, a child writes 1, 2, 3... until the parent, that reads,
+kills it at a random moment. The parent takes over the write role, writes
+its own numbers starting from "restart" and reads everything back: the numbers
+of the child must be contiguous and followed by the numbers of the parent.
+*/
+
+#define theLimit 1000000
+#define restart 1000000000ull
+
+static void readerChild(int const fd) {
+    ShmQueue queue = mkShmQueue();
+    int const failed = shmQueueAttach(&queue, fd) || shmQueueClaim(&queue, shmReader);
+    assert(!failed);
+    for (uint64_t expect = 1; expect <= theLimit; ++expect) {
+        uint64_t item;
+        while (shmReadItem(&queue, &item)) {
+            assert(errno == EAGAIN);
+            sched_yield();
+        }
+        assert(item == expect);
+    }
+    shmQueueDetach(&queue);
+    exit(0);
+}
+
+static void writerChild(int const fd) {
+    ShmQueue queue = mkShmQueue();
+    int const failed = shmQueueAttach(&queue, fd) || shmQueueClaim(&queue, shmWriter);
+    assert(!failed);
+    for (uint64_t value = 1;; ++value)
+        while (shmWriteItem(&queue, value)) sched_yield();
+}
+
+int main (int argc, char * argv[]) {
+    unsigned int seed = argc >= 2 ? atoi(argv[1]) : getpid();
+    srand(seed);
+    printf("The seed used:%d\n", seed);
+    fflush(stdout);
+    int const fd = memfd_create("testShm", 0);
+    assert(fd >= 0);
+    ShmQueue queue = mkShmQueue();
+    int failed = shmQueueCreate(&queue, fd, 8, 61);
+    assert(!failed);
+    pid_t child = fork();
+    if (!child) readerChild(fd);
+    failed = shmQueueClaim(&queue, shmWriter);
+    assert(!failed);
+    for (uint64_t value = 1; value <= theLimit; ++value)
+        while (shmWriteItem(&queue, value)) sched_yield();
+    int status;
+    pid_t waited = waitpid(child, &status, 0);
+    assert(child == waited);
+    assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+    shmQueueDetach(&queue);
+
+    for (int round = 0; round < 20; ++round) {
+        failed = shmQueueAttach(&queue, fd);
+        assert(!failed);
+        child = fork();
+        if (!child) writerChild(fd);
+        failed = shmQueueClaim(&queue, shmReader);
+        assert(!failed);
+        uint64_t expect = 1;
+        int const before = 1 + rand() % 5000;
+        for (int i = 0; i < before;) {
+            uint64_t item;
+            if (shmReadItem(&queue, &item)) {
+                sched_yield();
+                continue;
+            }
+            /* an old round may have left the tail of its numbers */
+            if (i == 0 && item != 1) continue;
+            assert(item == expect);
+            ++expect;
+            ++i;
+        }
+        while (!shmQueuePeerAlive(&queue, shmWriter)) sched_yield();
+        failed = shmQueueClaim(&(ShmQueue){queue.base, queue.size, shmNone}, shmWriter);
+        assert(-1 == failed);
+        kill(child, SIGKILL);
+        waited = waitpid(child, &status, 0);
+        assert(child == waited);
+        ShmQueue writer = mkShmQueue();
+        failed = shmQueueAttach(&writer, fd) || shmQueueClaim(&writer, shmWriter);
+        assert(!failed);
+        uint64_t next = restart;
+        for (int i = 0; i < 1000;) {
+            if (next < restart + 500 && 0 == shmWriteItem(&writer, next)) ++next;
+            uint64_t item;
+            if (shmReadItem(&queue, &item)) continue;
+            if (item < restart) {
+                assert(item == expect);
+                ++expect;
+            } else {
+                assert(item == restart + i);
+                ++i;
+            }
+            if (i == 500) break;
+        }
+        shmQueueDetach(&writer);
+        shmQueueDetach(&queue);
+    }
+    printf("shm ok\n");
+    return 0;
+}
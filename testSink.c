@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include "FdSink.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <assert.h>
+
+/*
+We test like this.
+First buffers of many sizes, empty ones too, go through a non blocking pipe
+that fills up, so the writes stop in the middle of buffers; what comes out of
+the pipe must be the buffers in order and every buffer must be released once.
+Then a write thread sends "theLimit" small records through a socket pair with
+sendmsg while the main thread drains and a reader thread checks the stream.
+Last a closed queue: what was in it is written, then the drain ends with EPIPE.
+*/
+
+#define bufferCount 300
+#define theLimit 100000
+
+static Queue queue;
+static int volatile released[bufferCount];
+
+static void releaseBuffer(IoBuffer * const buffer, void * const context) {
+    ++released[buffer - (IoBuffer *)context];
+}
+
+static void * writer(void * arg) {
+    IoBuffer * const buffers = arg;
+    for (long int i = 0; i < theLimit; ++i) {
+        IoBuffer * const buffer = &buffers[i % bufferCount];
+        /* The sink released it when it gets back to zero. */
+        while (released[i % bufferCount] < i / bufferCount) sched_yield();
+        snprintf(buffer->data, 16, "%015ld", i);
+        buffer->length = 16;
+        while (writeItem(&queue, buffer)) sched_yield();
+    }
+    return NULL;
+}
+
+static void * checker(void * arg) {
+    int const fd = (long int)arg;
+    char record[16];
+    for (long int i = 0; i < theLimit; ++i) {
+        for (size_t got = 0; got < sizeof(record);) {
+            ssize_t const n = read(fd, record + got, sizeof(record) - got);
+            assert(n > 0);
+            got += n;
+        }
+        assert(strtol(record, NULL, 10) == i && record[15] == 0);
+    }
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    static void * sectors[4][128];
+    static IoBuffer buffers[bufferCount];
+    static char data[bufferCount * 1000];
+    static char out[bufferCount * 1000];
+    int failed = 0;
+    ssize_t drained;
+
+    queue = mkQueue();
+    for (int s = 0; s < 4; ++s) failed |= submitSector(&queue, sectors[s], sizeof(sectors[s]));
+    assert(!failed);
+    size_t total = 0;
+    for (int i = 0; i < bufferCount; ++i) {
+        buffers[i].data = data + total;
+        buffers[i].length = i % 7 ? i * 3 % 1000 : 0;
+        for (size_t j = 0; j < buffers[i].length; ++j) data[total + j] = i + j;
+        total += buffers[i].length;
+    }
+    int pipes[2];
+    failed = pipe(pipes);
+    assert(!failed);
+    fcntl(pipes[1], F_SETFL, O_NONBLOCK);
+    fcntl(pipes[1], F_SETPIPE_SZ, 4096);
+    FdSink * sink = createFdSink(&queue, pipes[1], sinkWritev, releaseBuffer, buffers);
+    assert(sink);
+    drained = fdSinkDrain(sink);
+    assert(0 == drained);
+    int sent = 0;
+    size_t received = 0;
+    int calls = 0;
+    while (received < total) {
+        while (sent < bufferCount && !writeItem(&queue, &buffers[sent])) ++sent;
+        ssize_t const written = fdSinkDrain(sink);
+        assert(written >= 0 || errno == EAGAIN);
+        ++calls;
+        ssize_t const n = read(pipes[0], out + received, 1000);
+        assert(n > 0);
+        received += n;
+    }
+    assert(sent == bufferCount && 0 == fdSinkPending(sink));
+    assert(0 == memcmp(out, data, total));
+    for (int i = 0; i < bufferCount; ++i) assert(released[i] == 1);
+    assert(calls < bufferCount);
+    destroyFdSink(sink);
+    close(pipes[0]);
+    close(pipes[1]);
+
+    int pair[2];
+    failed = socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    assert(!failed);
+    memset((void *)released, 0, sizeof(released));
+    char * const records = malloc(bufferCount * 16);
+    for (int i = 0; i < bufferCount; ++i) buffers[i].data = records + i * 16;
+    sink = createFdSink(&queue, pair[0], sinkSendmsg, releaseBuffer, buffers);
+    assert(sink);
+    pthread_t threads[2];
+    failed = pthread_create(&threads[0], NULL, writer, buffers);
+    failed |= pthread_create(&threads[1], NULL, checker, (void*)(long int)pair[1]);
+    assert(!failed);
+    long int done = 0;
+    while (done < theLimit * 16l) {
+        ssize_t const written = fdSinkDrain(sink);
+        assert(written >= 0);
+        if (!written) sched_yield();
+        done += written;
+    }
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    destroyFdSink(sink);
+    free(records);
+    close(pair[0]);
+    close(pair[1]);
+
+    static void * spare[2][32];
+    Queue closing = mkQueue();
+    for (int s = 0; s < 2; ++s) failed |= submitSector(&closing, spare[s], sizeof(spare[s]));
+    failed |= pipe(pipes);
+    assert(!failed);
+    memset((void *)released, 0, sizeof(released));
+    sink = createFdSink(&closing, pipes[1], sinkWritev, releaseBuffer, buffers);
+    assert(sink);
+    buffers[0].data = buffers[1].data = data;
+    buffers[0].length = buffers[1].length = 16;
+    failed = writeItem(&closing, &buffers[0]);
+    failed |= writeItem(&closing, &buffers[1]);
+    failed |= closeQueue(&closing);
+    assert(!failed);
+    drained = fdSinkDrain(sink);
+    assert(32 == drained);
+    assert(released[0] == 1 && released[1] == 1);
+    drained = fdSinkDrain(sink);
+    assert(-1 == drained && errno == EPIPE);
+    /* Reset by the writer, the queue is not read again and the sink stays ended. */
+    struct QueueSector * const taken = releaseSectors(&closing);
+    assert(taken);
+    drained = fdSinkDrain(sink);
+    assert(-1 == drained && errno == EPIPE);
+    /* The end seen with buffers still pending: they are written first. */
+    destroyFdSink(sink);
+    closing = mkQueue();
+    for (int s = 0; s < 2; ++s) failed |= submitSector(&closing, spare[s], sizeof(spare[s]));
+    assert(!failed);
+    fcntl(pipes[1], F_SETFL, O_NONBLOCK);
+    sink = createFdSink(&closing, pipes[1], sinkWritev, releaseBuffer, buffers);
+    assert(sink);
+    static char big[1 << 20];
+    buffers[2].data = big;
+    buffers[2].length = sizeof(big);
+    int const queued = writeItem(&closing, &buffers[2]);
+    assert(0 == queued);
+    ssize_t const part = fdSinkDrain(sink);
+    assert(part > 0 && (size_t)part < sizeof(big));
+    failed = closeQueue(&closing);
+    assert(!failed);
+    ssize_t const blocked = fdSinkDrain(sink);
+    assert(blocked == -1 && errno == EAGAIN && 1 == fdSinkPending(sink));
+    for (size_t left = sizeof(big) - part; left;) {
+        ssize_t const n = read(pipes[0], big, sizeof(big));
+        assert(n > 0);
+        ssize_t const written = fdSinkDrain(sink);
+        assert(written >= 0 || errno == EAGAIN);
+        if (written > 0) left -= written;
+    }
+    assert(released[2] == 1);
+    drained = fdSinkDrain(sink);
+    assert(-1 == drained && errno == EPIPE);
+    destroyFdSink(sink);
+    close(pipes[0]);
+    close(pipes[1]);
+    printf("fd sink ok\n");
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "FdSource.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+/*
+We test like this.
+A feeder thread writes a known stream of "streamSize" bytes into a pipe in
+chunks of odd sizes; the main thread is the source and a reader thread checks
+the stream from the buffers and releases them.
+Then the feeder sends "messageCount" datagrams of different sizes through a
+socket pair and the reader checks that every buffer holds one whole message.
+Last the data read for a closed channel is counted as dropped and its buffer
+goes back into the pool.
+*/
+
+#define streamSize 4000000
+#define messageCount 20000
+
+static BufferChannel * channel;
+static int volatile readerDone;
+
+static void * streamFeeder(void * arg) {
+    int const fd = (long int)arg;
+    static char chunk[5000];
+    for (long int sent = 0; sent < streamSize;) {
+        int size = 1 + rand() % sizeof(chunk);
+        if (size > streamSize - sent) size = streamSize - sent;
+        for (int i = 0; i < size; ++i) chunk[i] = (char)((sent + i) * 7);
+        for (int done = 0; done < size;) {
+            ssize_t const n = write(fd, chunk + done, size - done);
+            assert(n > 0);
+            done += n;
+        }
+        sent += size;
+    }
+    close(fd);
+    return NULL;
+}
+
+static void * streamReader(void * arg) {
+    for (long int got = 0; got < streamSize;) {
+        IoBuffer * const buffer = channelReceive(channel);
+        if (!buffer) {
+            channelFlushReturns(channel);
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < buffer->length; ++i)
+            assert(buffer->data[i] == (char)((got + i) * 7));
+        got += buffer->length;
+        channelRelease(channel, buffer);
+    }
+    channelFlushReturns(channel);
+    readerDone = 1;
+    return NULL;
+}
+
+static void * messageFeeder(void * arg) {
+    int const fd = (long int)arg;
+    char message[200];
+    for (int m = 0; m < messageCount; ++m) {
+        int const size = 1 + m % sizeof(message);
+        memset(message, m, size);
+        ssize_t const sent = send(fd, message, size, 0);
+        assert(sent == size);
+    }
+    return NULL;
+}
+
+static void * messageReader(void * arg) {
+    for (int m = 0; m < messageCount;) {
+        IoBuffer * const buffer = channelReceive(channel);
+        if (!buffer) {
+            channelFlushReturns(channel);
+            sched_yield();
+            continue;
+        }
+        assert(buffer->length == (size_t)(1 + m % 200));
+        for (size_t i = 0; i < buffer->length; ++i) assert(buffer->data[i] == (char)m);
+        ++m;
+        channelRelease(channel, buffer);
+    }
+    readerDone = 1;
+    return NULL;
+}
+
+int main (int argc, char * argv[]) {
+    pthread_t threads[2];
+    int failed;
+
+    channel = createBufferChannel(64, 1024, 16, 8);
+    assert(channel);
+    int pipes[2];
+    failed = pipe(pipes);
+    assert(!failed);
+    FdSource * source = createFdSource(channel, pipes[0], sourceReadv, 16);
+    assert(source);
+    assert(fdSourceCapacity(source) == 1024 - sizeof(IoBuffer));
+    failed = pthread_create(&threads[0], NULL, streamFeeder, (void*)(long int)pipes[1]);
+    failed |= pthread_create(&threads[1], NULL, streamReader, NULL);
+    assert(!failed);
+    long int polls = 0, buffers = 0;
+    while (!fdSourceEnded(source)) {
+        int const sent = fdSourcePoll(source);
+        assert(sent >= 0);
+        if (!sent) sched_yield();
+        buffers += sent;
+        ++polls;
+    }
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    assert(buffers >= streamSize / (long int)fdSourceCapacity(source) && polls < buffers);
+    destroyFdSource(source);
+    destroyBufferChannel(channel);
+    close(pipes[0]);
+
+    readerDone = 0;
+    channel = createBufferChannel(64, 256, 16, 8);
+    assert(channel);
+    int pair[2];
+    failed = socketpair(AF_UNIX, SOCK_DGRAM, 0, pair);
+    assert(!failed);
+    source = createFdSource(channel, pair[0], sourceRecvmmsg, 32);
+    assert(source);
+    failed = pthread_create(&threads[0], NULL, messageFeeder, (void*)(long int)pair[1]);
+    failed |= pthread_create(&threads[1], NULL, messageReader, NULL);
+    assert(!failed);
+    for (buffers = 0; buffers < messageCount;) {
+        int const sent = fdSourcePoll(source);
+        assert(sent >= 0);
+        if (!sent) sched_yield();
+        buffers += sent;
+    }
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    assert(readerDone);
+    destroyFdSource(source);
+    destroyBufferChannel(channel);
+    close(pair[0]);
+    close(pair[1]);
+
+    /* A closed channel takes nothing: the filled buffer is dropped and goes back into the pool. */
+    channel = createBufferChannel(4, 256, 4, 4);
+    assert(channel);
+    failed = pipe(pipes);
+    assert(!failed);
+    source = createFdSource(channel, pipes[0], sourceReadv, 4);
+    assert(source);
+    ssize_t const put = write(pipes[1], "lost", 4);
+    assert(4 == put);
+    failed = channelClose(channel);
+    assert(!failed);
+    int const lost = fdSourcePoll(source);
+    assert(-1 == lost && errno == EPIPE && 1 == fdSourceDropped(source));
+    for (int i = 0; i < 4; ++i) {
+        void * const buffer = channelAlloc(channel);
+        assert(buffer);
+    }
+    destroyFdSource(source);
+    destroyBufferChannel(channel);
+    close(pipes[0]);
+    close(pipes[1]);
+    printf("fd source ok\n");
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "SpillQueue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+/*
+We test like this.
+A queue with two tiny sectors and small segment files, so it spills a lot.
+In the values mode a write thread sends the numbers from 1 up to "theLimit"
+and closes the queue while a slow read thread expects them in order, the end
+comes only after the spilled items.
+In the records mode one thread, led by a pseudo random dice, writes records
+holding their own sequence number and reads them back in order.
+*/
+
+#define theLimit 400000
+
+static void * valuesReader(void * arg) {
+    SpillQueue * const queue = arg;
+    for (long int expect = 1;; ++expect) {
+        void * got;
+        while (!(got = spillReadItem(queue))) sched_yield();
+        if (got == QUEUE_END) {
+            assert(expect == theLimit + 1);
+            break;
+        }
+        assert((long int)got == expect);
+        if (expect % 50000 == 0) usleep(2000);
+    }
+    return NULL;
+}
+
+static void testValues(void) {
+    static char sectors[2][QUEUE_SECTOR_SIZE(16)];
+    Queue memory = mkQueue();
+    for (int i = 0; i < 2; ++i) submitSector(&memory, sectors[i], sizeof(sectors[i]));
+    SpillQueue * const queue = createSpillQueue(&memory, spillValues, "/tmp", 4096);
+    assert(queue);
+    pthread_t reader;
+    int const created = pthread_create(&reader, NULL, valuesReader, queue);
+    assert(0 == created);
+    int spilled = 0;
+    for (long int value = 1; value <= theLimit; ++value) {
+        int const where = spillWriteItem(queue, (void*)value);
+        assert(where == 0 || where == 1);
+        spilled += where;
+    }
+    int const closed = closeQueue(&memory);
+    assert(0 == closed);
+    pthread_join(reader, NULL);
+    assert(!spillPending(queue));
+    /* Reset by the writer, the queue is not read again and stays ended. */
+    struct QueueSector * const released = releaseSectors(&memory);
+    assert(released);
+    void * const end = spillReadItem(queue);
+    assert(QUEUE_END == end);
+    destroySpillQueue(queue);
+    printf("values ok, %d spilled\n", spilled);
+}
+
+static void testRecords(void) {
+    static char sectors[3][QUEUE_SECTOR_SIZE(5)];
+    static union { SpillRecord record; char bytes[64]; } pool[200];
+    Queue memory = mkQueue();
+    for (int i = 0; i < 3; ++i) submitSector(&memory, sectors[i], sizeof(sectors[i]));
+    SpillQueue * const queue = createSpillQueue(&memory, spillRecords, "/tmp", 256);
+    assert(queue);
+    int written = 0, read = 0, spilled = 0;
+    while (read < theLimit / 10) {
+        if (rand() & 1 && written < theLimit / 10 && written - read < 200) {
+            /* a buffer is not reused while its record can be in the queue */
+            SpillRecord * const record = &pool[written % 200].record;
+            record->length = sizeof(int) + written % 40;
+            memcpy(record->data, &written, sizeof(int));
+            memset(record->data + sizeof(int), written & 0xff, written % 40);
+            int const where = spillWriteItem(queue, record);
+            assert(where == 0 || where == 1);
+            spilled += where;
+            ++written;
+        } else {
+            SpillRecord const * const record = spillReadItem(queue);
+            if (!record) continue;
+            int number;
+            memcpy(&number, record->data, sizeof(int));
+            assert(number == read);
+            assert(record->length == sizeof(int) + read % 40);
+            for (uint32_t i = sizeof(int); i < record->length; ++i)
+                assert(record->data[i] == (read & 0xff));
+            ++read;
+        }
+    }
+    destroySpillQueue(queue);
+    printf("records ok, %d spilled\n", spilled);
+}
+
+int main (int argc, char * argv[]) {
+    unsigned int seed = argc >= 2 ? atoi(argv[1]) : getpid();
+    srand(seed);
+    printf("The seed used:%d\n", seed);
+    testValues();
+    testRecords();
+    return 0;
+}
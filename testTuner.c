@@ -0,0 +1,73 @@
+#include "SectorTuner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+We test like this.
+One thread plays both sides. First a burst of writes with no reads: the tuner
+must grow the queue instead of failing. Then a long quiet time with a few items
+in flight: the tuner must retire the big sectors, down to minSectors.
+The items must come out in order all the time.
+*/
+
+static long int written = 0;
+static long int read = 0;
+
+static void readSome(Queue * const queue, int count) {
+    for (; count > 0; --count) {
+        long int const got = (long int)readItem(queue);
+        if (!got) return;
+        ++read;
+        assert(got == read);
+    }
+}
+
+int main (int argc, char * argv[]) {
+    Queue queue = mkQueue();
+    TunerConfig const config = {8, 4096, 2, 1 << 20, 256, 16, 4};
+    SectorTuner * const tuner = createSectorTuner(&queue, &config);
+    assert(tuner);
+    TunerStats stats;
+
+    int failed = 0;
+    for (int i = 0; i < 20000; ++i) failed |= tunerWriteItem(tuner, (void*)++written);
+    assert(!failed);
+    tunerStats(tuner, &stats);
+    printf("after the burst: %d sectors, %zu bytes, %lu grown\n",
+            stats.sectors, stats.bytes, stats.grown);
+    assert(stats.enomem > 0 && !stats.failed && stats.sectors > 2);
+    assert(stats.bytes >= 20000 * sizeof(void*));
+
+    readSome(&queue, 20000);
+    assert(read == written);
+    for (int i = 0; i < 200000; ++i) {
+        failed = tunerWriteItem(tuner, (void*)++written);
+        assert(!failed);
+        readSome(&queue, 1);
+    }
+    readSome(&queue, 10);
+    assert(read == written);
+    /* the writes stopped, the empty queue gives up its last big sector */
+    for (int i = 0; i < 100; ++i) tunerMaintain(tuner);
+    tunerStats(tuner, &stats);
+    printf("after the quiet time: %d sectors, %zu bytes, %lu retired\n",
+            stats.sectors, stats.bytes, stats.retired);
+    assert(stats.sectors == config.minSectors);
+    assert(stats.bytes == config.minSectors * QUEUE_SECTOR_SIZE(config.minItems));
+
+    /* the memory cap makes the writes fail at last */
+    failed = 0;
+    for (int i = 0; i < 200000 && !failed; ++i)
+        if (tunerWriteItem(tuner, (void*)(written + 1))) failed = 1;
+        else ++written;
+    assert(failed);
+    tunerStats(tuner, &stats);
+    assert(stats.bytes <= config.maxBytes && stats.failed == 1);
+    readSome(&queue, 1000000);
+    assert(read == written);
+    failed = destroySectorTuner(tuner);
+    assert(!failed);
+    printf("tuner ok\n");
+    return 0;
+}